@@ -1,916 +1,1593 @@
-#include <assert.h>
-#include <memory>
-#include <utility>
-
-extern "C" int printf(const char*, ...);
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <new>
+#include <stdlib.h>
+#include <string>
+#include <sys/socket.h>
+
+#include "symmetric_coro_examples.h"
+#include "symmetric_coro_perf.h"
+#include "symmetric_coro_pool.h"
+#include "symmetric_coro_stats.h"
+#include "symmetric_coro_trace.h"
+
+// Counts heap allocations, so tests can check that nothing is allocated
+// per hop. The replacements are kept out of line: inlined, GCC sees the
+// `free` of a pointer from `operator new` and reports a mismatch at -Wall.
+
+static size_t allocation_count = 0;
+
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    ++allocation_count;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
 
-using namespace std;
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
 
-namespace std {
-///////////////////////////////////////////////////////////
-// Low level CPS support
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
 
-class cps_target {
-public:
-  struct cps_arg {
-    cps_arg() : data(nullptr) {}
-    cps_arg(int i) : i(i) {}
-    cps_arg(float f) : f(f) {}
-    cps_arg(double d) : d(d) {}
-
-    operator int() { return i; }
-    operator float() { return f; }
-    operator double() { return d; }
-
-    template <typename T> operator T() { return *(reinterpret_cast<T*>(data)); }
-
-    union {
-      int i;
-      float f;
-      double d;
-      void *data;
-    };
-  };
+void test_yield_once()
+{
+    printf("*** Test yield_once ***\n");
+    yield_once yo;
 
-  // Packs a continuation and type-erased data
-  struct cps_call_data {
-    cps_arg data;
-    cps_target* cont;
-  };
+    assert(!yo.done());
 
-  // This trampoline simulates tail calls
-  static cps_call_data trampoline(cps_target* target, cps_arg arg) {
-    assert(target != nullptr);
+    yo();
+    assert(!yo.done());
 
-    cps_target* callee = target;
-    cps_arg data = arg;
-    cps_target* cont = nullptr;
+    yo(); // yo();
+    assert(yo.done());
+}
 
-    {
-      cps_call_data call_data = callee->__body({data, cont});
 
-      cont = callee;
-      callee = call_data.cont;
-      data = call_data.data;
-    }
+void test_print_counter()
+{
+    printf("*** Test print_counter ***\n");
+    print_counter pc(1, 3);
 
-    while (callee != nullptr) {
-      cps_call_data call_data = callee->__body({data, cont});
+    assert(!pc.done());
 
-      cont = callee;
-      callee = call_data.cont;
-      data = call_data.data;
+    for (int i = 0; i < 4; ++i) {
+        pc();
+        assert(!pc.done());
     }
 
-    return {data, cont};
-  }
-
-  // The coroutine body and current suspend point
-  virtual cps_call_data __body(cps_call_data call_data) = 0;
-};
+    assert(!pc.done());
+}
 
-template<class... Ts> class coroutine;
-template<class... Ts> class resume_continuation;
 
+void test_print_range()
+{
+    printf("*** Test print range ***\n");
+    const int start = 10;
+    const int end = 14;
+    print_range r(start, end);
 
-///////////////////////////////////////////////////////////
-// Resume continuation implementation
+    while (!r.done())
+      r();
+}
 
-template<> class coroutine<>;
 
-template<> class resume_continuation<> {
-  friend class coroutine<>;
+void test_range()
+{
+    printf("*** Test range ***\n");
+    const int start = 10;
+    const int end = 14;
+    range r(start, end);
 
-public:
-  bool is_valid() const {
-    return _target != get_invalid_continuation();
-  }
-
-protected:
-  resume_continuation()
-    : _target(get_invalid_continuation()) // An invalidated continuation points to itself
-  {}                // because nullptr is a valid target.
-
-  resume_continuation(cps_target *target)
-    : _target(target)
-  {}
-
-  resume_continuation& operator=(resume_continuation&& other) {
-    if (other.is_valid()) {
-      _target = other._target;
-      other.invalidate();
-    } else {
-      invalidate();
+    while( !r.done() ) {
+        int val = r();
+        printf("%d\n", val);
     }
 
-    return *this;
-  }
-
-  cps_target* release() {
-    cps_target* target = _target;
-    invalidate();
-    return target;
-  }
+    assert(r.done());
+}
 
-  void reset(cps_target* new_target) {
-    _target = new_target;
-  }
 
-  cps_target::cps_arg call_with_trampoline() {
-    cps_target::cps_call_data call_data = cps_target::trampoline(release(), {});
-    reset(call_data.cont);
-    return call_data.data;
-  }
+void test_echo()
+{
+    printf("*** Test echo ***\n");
+    echo e;
 
-  template<typename A>
-  cps_target::cps_arg call_with_trampoline(A arg) {
-    cps_target::cps_call_data call_data = cps_target::trampoline(release(), {arg});
-    reset(call_data.cont);
-    return call_data.data;
-  }
+    assert(!e.done());
 
-private:
-  class invalid_cps_target : public cps_target {
-    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override {
-      assert(false && "Invoked invalid continuation");
-      return {{}, nullptr};
+    for (int i = 0; i < 4; ++i) {
+        int response = e(i);
+        printf("%d -> %d\n", i, response);
+        assert(response == i);
+        assert(!e.done());
     }
-  };
-
-  static cps_target* get_invalid_continuation() {
-    return reinterpret_cast<invalid_cps_target*>(~0);
-  }
 
-  void invalidate() {
-    _target = get_invalid_continuation();
-  }
+    assert(!e.done());
+}
 
-  // Should we have this at all??? Should the continuation be a cps_target? I think not...
-  // Maybe instead we should have a helper cps_target for the call with a trampoline.
-  cps_target* _target;
-};
 
+void test_multiply()
+{
+    printf("*** Test mutiply ***\n");
+    range r1(0, 4);
+    range r2(2, 10);
 
+    multiply m(r1, r2);
 
-///////////////////////////////////////////////////////////
-// End-user resume continuation - type-safe wrappers on top
-// of the type-erased one.
+    assert(!m.done());
 
-template<> class resume_continuation<void(void)> : public resume_continuation<> {
-public:
-  resume_continuation()
-    : resume_continuation<>()
-  {}
+    while (!m.done()) {
+        assert(!r1.done());
+        assert(!r2.done());
 
-  resume_continuation(cps_target* target)
-    : resume_continuation<>(target)
-  {}
+        int product = m();
+        printf("%d\n", product);
+    }
 
-  resume_continuation(coroutine<void()> *c);
+    assert(r1.done());
+    assert(!r2.done());
+}
 
-  resume_continuation<void(void)>& operator=(resume_continuation<void(void)>&& other) {
-    resume_continuation<>::operator=(std::move(other));
-    return *this;
-  }
+void test_cps_arg()
+{
+    printf("*** Test cps_arg ***\n");
+    using cps_arg = cps_target::cps_arg;
+
+    struct rgba { unsigned char r, g, b, a; float weight; };
+    rgba color = cps_arg(rgba{ 1, 2, 3, 4, 0.5f });
+    assert(color.r == 1 && color.a == 4 && color.weight == 0.5f);
+
+    auto [x, y] = tuple<float, float>(cps_arg(1.5f, 2.5f));
+    assert(x == 1.5f && y == 2.5f);
+
+    tuple<int, float> t = cps_arg(make_tuple(3, 4.5f));
+    assert(get<0>(t) == 3 && get<1>(t) == 4.5f);
+
+    // Larger than the payload unless CPS_ARG_CAPACITY is raised, and then
+    // passed by address, which const values can be as well.
+    const string_view sv = "by address";
+    string_view view = cps_arg(sv);
+    assert(view.data() == sv.data() && view.size() == sv.size());
+
+#if CPS_ARG_CAPACITY >= 32
+    struct quad { double x, y, z, w; };
+    quad q = cps_arg(quad{ 1, 2, 3, 4 });
+    assert(q.x == 1 && q.w == 4);
+#endif
+}
 
-  void operator()() {
-    call_with_trampoline();
-  }
-};
+void test_dot()
+{
+    printf("*** Test dot ***\n");
+    dot d;
 
-template<class R> class resume_continuation<R(void)> : public resume_continuation<> {
-public:
-  resume_continuation()
-    : resume_continuation<>()
-  {}
+    assert(d(1, 2) == 2);
+    assert(d(3, 4) == 14);
+    assert(d(5, 6) == 44);
+    assert(!d.done());
+}
 
-  resume_continuation(cps_target* target)
-    : resume_continuation<>(target)
-  {}
+struct copy_counter {
+    static inline int copies = 0;
+    static inline int live = 0;
 
-  resume_continuation(coroutine<R()> *c);
+    int value;
 
-  R operator()() {
-    return call_with_trampoline();
-  }
+    copy_counter(int value) : value(value) { ++live; }
+    copy_counter(const copy_counter& other) : value(other.value) { ++copies; ++live; }
+    copy_counter(copy_counter&& other) : value(other.value) { ++live; }
+    copy_counter& operator=(const copy_counter& other) { value = other.value; ++copies; return *this; }
+    copy_counter& operator=(copy_counter&&) = default;
+    ~copy_counter() { --live; }
 };
 
-template<class A> class resume_continuation<void(A)> : public resume_continuation<> {
-public:
-  resume_continuation()
-    : resume_continuation<>()
-  {}
-
-  resume_continuation(cps_target* target)
-    : resume_continuation<>(target)
-  {}
+// Reads its first argument straight into a member rather than through
+// `set_initial_value`, then waits.
+class keep_first : public coroutine<void(string)> {
+    friend struct std::cps_dispatch_access;
 
-  resume_continuation(coroutine<void(A)> *c);
-
-  void operator()(A arg) {
-    call_with_trampoline(arg);
-  }
-};
-
-template<class R, class A> class resume_continuation<R(A)> : public resume_continuation<> {
 public:
-  resume_continuation()
-    : resume_continuation<>()
-  {}
-
-  resume_continuation(cps_target* target)
-    : resume_continuation<>(target)
-  {}
+    string value;
 
-  resume_continuation(coroutine<R(A)> *c);
+private:
+    cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            value = process_resume<string>(get_caller(), call_data);
+            return prepare_to_suspend(1, get_caller());
 
-  R operator()(A arg) {
-    return call_with_trampoline(arg);
-  }
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
 };
 
-///////////////////////////////////////////////////////////
-// Base coroutine class - stores just the suspend point.
+// Posts `then`, calls `inner` if there is one, and throws.
+class thrower : public coroutine<void()> {
+    friend struct std::cps_dispatch_access;
 
-template<> class coroutine<> : public cps_target {
 public:
-  bool done() const {
-    return _sp == -1;
-  }
-
-protected:
-  // Inside a coroutine body, some invocations get rewritten as follows:
-  //
-  //   1) `coroutine::yield()`   >>>    `get_caller()()`
-  //
-  //   2) `coro()` >>> `coro._cont()`
-  //
-  //   3) `rc()`, where `rc` is a `resume_continuation`   >>>
-  //      ```
-  //        prepare_to_suspend(N, rc);
-  //      case N:
-  //        process_resume(rc, call_data)
-  //      ```
-  //      where `N` is a generated id for the suspend point, unique within this
-  //      coroutine body.
-
-  using suspend_point = int;
-
-  coroutine()
-    : _sp(0)
-  {}
-
-  suspend_point get_suspend_point() const {
-    return _sp;
-  }
-
-  cps_call_data prepare_to_suspend(suspend_point sp, resume_continuation<>& cont) {
-    _sp = sp;
-    return {{}, cont.release()};
-  }
-
-  template<typename ValType>
-  cps_call_data prepare_to_suspend(suspend_point sp, resume_continuation<>& cont, ValType val) {
-    _sp = sp;
-    return {{val}, cont.release()};
-  }
-
-  void process_resume(resume_continuation<>& cont, cps_call_data& call_data) {
-    cont.reset(call_data.cont);
-  }
-
-  template<typename ValType>
-  ValType process_resume(resume_continuation<>& cont, cps_call_data& call_data) {
-    cont.reset(call_data.cont);
-    return call_data.data;
-  }
-
-  constexpr static suspend_point _sp_done = -1;
+    thrower(coroutine<void()>* then, thrower* inner = nullptr)
+        : then(then)
+        , inner(inner)
+    {}
 
 private:
-  suspend_point _sp;
-};
-
-///////////////////////////////////////////////////////////
-// Type-safe coroutine classes for user coroutines - add the
-// two resume continuations.
-
-template<> class coroutine<void(void)> : public coroutine<> {
-public:
- // Always inlined in non-coroutines, injected in coroutine bodies
-  void operator()() {
-    _cont();
-  }
-
-  auto& get_cont() { return _cont; }
-
-protected:
-  coroutine()
-    : _cont(this)
-    , _caller()
-  {}
-
-  // Always inlined
-  void yield() {
-    get_caller()();
-  }
+    cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+            if (then)
+                cps_run_loop::post(*then);
+            if (inner)
+                (*inner)();
+            throw runtime_error("thrown from a body");
 
-  resume_continuation<void(void)>& get_caller() {
-    return _caller;
-  }
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
 
-private:
-  resume_continuation<void(void)> _cont;
-  resume_continuation<void(void)> _caller;
+    coroutine<void()>* then;
+    thrower* inner;
 };
 
-resume_continuation<void()>::resume_continuation(coroutine<void()> *c)
-  : resume_continuation<>(static_cast<coroutine<>*>(c))
-{}
-
-template<class R> class coroutine<R(void)> : public coroutine<> {
+void test_move_echo()
+{
+    printf("*** Test move_echo ***\n");
 
-public:
- // Always inlined in non-coroutines, injected in coroutine bodies
-  R operator()() {
-    return _cont();
-  }
+    {
+        move_echo<string> e;
+        string s(100, 'x');
+
+        size_t allocations = allocation_count;
+        for (int i = 0; i < 1000; ++i)
+            s = e(std::move(s));
+        printf("%zu allocations in 1000 hops\n", allocation_count - allocations);
+        assert(allocation_count == allocations);
+        assert(s == string(100, 'x'));
+    }
 
-  auto& get_cont() { return _cont; }
+    {
+        move_echo<unique_ptr<int>> e;
+        unique_ptr<int> p = e(make_unique<int>(42));
+        p = e(std::move(p));
+        assert(p && *p == 42);
+    }
 
-protected:
-  coroutine()
-    : _cont(this)
-    , _caller()
-  {}
+    {
+        move_echo<copy_counter> e;
+        copy_counter c(7);
+        for (int i = 0; i < 10; ++i)
+            c = e(std::move(c));
+        assert(c.value == 7);
+        assert(copy_counter::copies == 0);
+    }
+    // The frame destroyed its `val` and its initial value.
+    assert(copy_counter::live == 0);
 
-  // Always inlined
-  void yield(R result) {
-    get_caller()(result);
-  }
+    {
+        // Never resumed, so there is nothing to destroy.
+        move_echo<copy_counter> e;
+    }
+    assert(copy_counter::live == 0);
 
-  resume_continuation<void(R)>& get_caller() {
-    return _caller;
-  }
+    {
+        // Suspended without an initial value, so there is none to destroy.
+        keep_first k;
+        k(string(100, 'y'));
+        assert(k.value == string(100, 'y') && !k.done());
+    }
+}
 
-private:
-  resume_continuation<R(void)> _cont;
-  resume_continuation<void(R)> _caller;
-};
+void test_coroutine_pool()
+{
+    printf("*** Test coroutine_pool ***\n");
 
-template<class R>
-resume_continuation<R()>::resume_continuation(coroutine<R()> *c)
-  : resume_continuation<>(static_cast<coroutine<>*>(c))
-{}
+    auto run = [] {
+        auto r1 = coroutine_pool<range>::create(0, 4);
+        auto r2 = coroutine_pool<range>::create(2, 10);
+        auto m = coroutine_pool<multiply>::create(*r1, *r2);
 
-template<class A> class coroutine<void(A)> : public coroutine<> {
-public:
- // Always inlined in non-coroutines, injected in coroutine bodies
-  void operator()(A arg) {
-    _cont(arg);
-  }
+        int sum = 0;
+        while (!m->done())
+            sum += (*m)();
+        return sum;
+    };
 
-  auto& get_cont() { return _cont; }
+    // The first run carves the slots out of a fresh slab.
+    assert(run() == 0 + 3 + 8 + 15);
+
+    size_t allocations = allocation_count;
+    for (int i = 0; i < 1000; ++i)
+        assert(run() == 26);
+    assert(allocation_count == allocations);
+
+    // Slots are recycled in LIFO order.
+    void* first = coroutine_pool<range>::create(0, 1).get();
+    assert(coroutine_pool<range>::create(0, 1).get() == first);
+
+    // A slot released on another thread goes back to the thread that
+    // allocated it.
+    thread owner([] {
+        auto r = coroutine_pool<range>::create(0, 4);
+        void* slot = r.get();
+        thread([r = std::move(r)]() mutable { r.reset(); }).join();
+        assert(coroutine_pool<range>::create(0, 1).get() == slot);
+    });
+    owner.join();
+}
 
-protected:
-  coroutine()
-    : _cont(this)
-    , _caller()
-  {}
+void test_frame_arena()
+{
+    printf("*** Test frame_arena ***\n");
+    frame_arena arena;
 
-  // Always inlined
-  A yield() {
-    return get_caller()();
-  }
+    auto request = [&arena] {
+        range& r1 = arena.create<range>(0, 4);
+        range& r2 = arena.create<range>(2, 10);
+        multiply& m = arena.create<multiply>(r1, r2);
 
-  void set_caller(resume_continuation<A(void)>&& caller) {
-    _caller = std::move(caller);
-  }
+        int sum = 0;
+        while (!m.done())
+            sum += m();
 
-  resume_continuation<A(void)>& get_caller() {
-    return _caller;
-  }
+        move_echo<copy_counter>& e = arena.create<move_echo<copy_counter>>();
+        assert(e(copy_counter(sum)).value == sum);
 
-  void set_initial_value(A&& value) {
-    new (&_initial_value) A(value);
-  }
+        arena.release();
+        return sum;
+    };
 
-  const A& get_initial_value() const {
-    return _initial_value;
-  }
+    assert(request() == 26);
+    assert(copy_counter::live == 0);
 
-private:
-  resume_continuation<void(A)> _cont;
-  resume_continuation<A(void)> _caller;
+    size_t allocations = allocation_count;
+    for (int i = 0; i < 1000; ++i)
+        assert(request() == 26);
+    assert(allocation_count == allocations);
+    assert(copy_counter::live == 0);
+}
 
-  union {
-    A _initial_value;
-  };
-};
+void test_goto_multiply()
+{
+    printf("*** Test goto_multiply ***\n");
+    range r1(0, 4);
+    range r2(2, 10);
+    range r3(0, 4);
+    range r4(2, 10);
 
-template<class A>
-resume_continuation<void(A)>::resume_continuation(coroutine<void(A)> *c)
-  : resume_continuation<>(static_cast<coroutine<>*>(c))
-{}
+    multiply m(r1, r2);
+    goto_multiply gm(r3, r4);
 
-template<class R, class A> class coroutine<R(A)> : public coroutine<> {
-public:
-  // Always inlined in non-coroutines, injected in coroutine bodies
-  R operator()(A arg) {
-    return _cont(arg);
-  }
+    while (!m.done()) {
+        assert(!gm.done());
 
-  auto& get_cont() { return _cont; }
+        int product = gm();
+        printf("%d\n", product);
+        assert(product == m());
+    }
 
-protected:
-  coroutine()
-    : _cont(this)
-    , _caller()
-  {}
+    assert(gm.done());
+    assert(r3.done());
+    assert(!r4.done());
+}
 
-  // Always inlined
-  A yield(R result) {
-    return get_caller()(result);
-  }
+void test_block_range()
+{
+    printf("*** Test block_range ***\n");
+    const int start = 10;
+    const int end = 150;
+    block_range r(start, end);
+
+    int expected = start;
+    int blocks = 0;
+    while (!r.done()) {
+        span<const int> block = r.next_block();
+        printf("block of %zu\n", block.size());
+        for (int v : block)
+            assert(v == expected++);
+        ++blocks;
+    }
 
-  void set_caller(resume_continuation<A(R)>&& caller) {
-    _caller = std::move(caller);
-  }
+    assert(expected == end);
+    assert(blocks == 3);
+}
 
-  resume_continuation<A(R)>& get_caller() {
-    return _caller;
-  }
+void test_block_multiply()
+{
+    printf("*** Test block_multiply ***\n");
+    range r1(0, 100);
+    range r2(2, 200);
+    multiply m(r1, r2);
 
-  void set_initial_value(A&& value) {
-    new (&_initial_value) A(value);
-  }
+    block_range b1(0, 100);
+    block_range b2(2, 200);
+    block_multiply bm(b1, b2);
+
+    int products = 0;
+    while (!bm.done()) {
+        for (int product : bm.next_block()) {
+            assert(!m.done());
+            assert(product == m());
+            ++products;
+        }
+    }
 
-  const A& get_initial_value() const {
-    return _initial_value;
-  }
+    assert(m.done());
+    assert(products == 100);
+}
 
-private:
-  resume_continuation<R(A)> _cont;
-  resume_continuation<A(R)> _caller;
+void test_closed_dispatch()
+{
+    printf("*** Test closed_dispatch ***\n");
+    using pipeline = closed_dispatch<range, multiply, echo, yield_once>;
 
-  union {
-    A _initial_value;
-  };
-};
+    range r1(0, 4);
+    range r2(2, 10);
+    multiply m(r1, r2);
 
+    // r2 is left out on purpose: it is resumed through the vtable.
+    pipeline::adopt(r1, m);
 
-template<class R, class A>
-resume_continuation<R(A)>::resume_continuation(coroutine<R(A)> *c)
-  : resume_continuation<>(static_cast<coroutine<>*>(c))
-{}
+    const int expected[] = { 0, 3, 8, 15 };
+    int n = 0;
+    while (!m.done()) {
+        int product = pipeline::call(m);
+        printf("%d\n", product);
+        assert(product == expected[n++]);
+    }
+    assert(n == 4);
 
-};
+    echo e;
+    pipeline::adopt(e);
+    for (int i = 0; i < 4; ++i)
+        assert(pipeline::call(e, i) == i);
 
+    dot d;
+    assert(pipeline::call(d, 2, 3) == 6);
 
-/// Example one: a coroutine that yields once. Demonstrates the difference
-/// between yielding and returning.
-///
-/// Should be able to be called exactly twice.
+    yield_once yo;
+    pipeline::adopt(yo);
+    pipeline::call(yo);
+    pipeline::call(yo);
+    assert(yo.done());
+}
 
-/*
-yield_once() : coroutine<void(void)>
+void test_scheduler()
 {
-  yield(); // get_caller()();
-  return;
+    printf("*** Test scheduler ***\n");
+    constexpr int tasks = 100;
+    constexpr int steps = 1000;
+    constexpr long expected = long(tasks) * (steps * (steps - 1) / 2);
+
+    for (unsigned workers : { 1u, 4u }) {
+        scheduler s(workers);
+        atomic<long> total{0};
+
+        vector<unique_ptr<scheduled_sum>> sums;
+        for (int i = 0; i < tasks; ++i) {
+            sums.emplace_back(new scheduled_sum(steps, total));
+            s.spawn(*sums.back());
+        }
+
+        s.run_until_idle();
+        printf("%u workers: %ld\n", workers, total.load());
+        assert(total.load() == expected);
+        for (auto& sum : sums)
+            assert(sum->done());
+
+        // The scheduler can be run again once idle.
+        scheduled_sum last(steps, total);
+        s.spawn(last);
+        s.run_until_idle();
+        assert(last.done());
+        assert(total.load() == expected + steps * (steps - 1) / 2);
+    }
 }
-*/
 
-// Translates to
-class yield_once : public coroutine<void(void)>
+template<class Queue>
+void test_shuttle()
 {
-public:
-    yield_once()
-    {}
-
-private:
-    struct corotine_state {
+    constexpr int round_trips = 10000;
+    Queue to_a, to_b;
+    atomic<bool> finished{false};
+    shuttle<Queue> s(round_trips, to_a, to_b, finished);
+
+    auto run = [&finished](Queue& q) {
+        while (!finished.load(memory_order_acquire))
+            if (!q.resume_one())
+                this_thread::yield();
     };
 
-    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
-    {
-        switch (get_suspend_point())
-        {
-        case 0:
-            // Initial suspend point - save caller
-            process_resume(get_caller(), call_data);
+    assert(to_a.push(s));
+    thread b(run, ref(to_b));
+    run(to_a);
+    b.join();
 
-            // yield() == get_caller()() == expansion of suspend_to(get_caller()())
-            return prepare_to_suspend(1, get_caller());
+    assert(s.done());
+    assert(s.visits_a == round_trips);
+    assert(s.visits_b == round_trips);
+}
 
-        case 1: // suspend point 1
-            process_resume(get_caller(), call_data);
+void test_handoff()
+{
+    printf("*** Test handoff ***\n");
+    test_shuttle<spsc_handoff_queue<4>>();
+    test_shuttle<mpsc_handoff_queue<4>>();
 
-            // return
-            return prepare_to_suspend(_sp_done, get_caller());
+    {
+        // A full queue leaves the continuation with its owner.
+        spsc_handoff_queue<1> q;
+        range r1(0, 2);
+        range r2(0, 2);
+        assert(q.push(r1.get_cont()));
+        assert(!r1.get_cont().is_valid());
+        assert(!q.push(r2.get_cont()));
+        assert(r2.get_cont().is_valid());
+    }
 
-        default:
-            assert(false && "Called a completed coroutine");
-            return {};
-        };
+    {
+        // Several producers, one consumer.
+        constexpr int producers = 4;
+        constexpr int per_producer = 1000;
+        mpsc_handoff_queue<64> q;
+        vector<unique_ptr<yield_once>> coros;
+        for (int i = 0; i < producers * per_producer; ++i)
+            coros.emplace_back(new yield_once);
+
+        vector<thread> threads;
+        for (int p = 0; p < producers; ++p)
+            threads.emplace_back([&q, &coros, p] {
+                for (int i = 0; i < per_producer; ++i)
+                    while (!q.push(*coros[p * per_producer + i]))
+                        this_thread::yield();
+            });
+
+        int resumed = 0;
+        while (resumed < producers * per_producer)
+            if (q.resume_one())
+                ++resumed;
+        for (thread& t : threads)
+            t.join();
+
+        assert(!q.resume_one());
+        for (auto& c : coros)
+            assert(!c->done());
     }
-};
+}
 
-void test_yield_once()
+void test_reactor()
 {
-    printf("*** Test yield_once ***\n");
-    yield_once yo;
-
-    assert(!yo.done());
+    printf("*** Test reactor ***\n");
 
-    yo();
-    assert(!yo.done());
+    {
+        // Several sessions over socketpairs, served in the same loop.
+        reactor r;
+        vector<unique_ptr<echo_session>> sessions;
+        vector<unique_ptr<echo_client>> clients;
+        for (int i = 0; i < 4; ++i) {
+            int fds[2];
+            int rc = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+            assert(rc == 0);
+            r.add(fds[0]);
+            r.add(fds[1]);
+            sessions.emplace_back(new echo_session(r, fds[0]));
+            clients.emplace_back(new echo_client(r, fds[1], 100, 1 + 60 * i));
+            r.spawn(*sessions.back());
+            r.spawn(*clients.back());
+        }
+
+        r.run();
+        assert(r.waiting() == 0);
+        for (auto& c : clients) {
+            assert(c->done());
+            assert(c->completed == 100);
+        }
+        for (auto& s : sessions)
+            assert(s->done());
+    }
 
-    yo(); // yo();
-    assert(yo.done());
-}
+    {
+        // Writes that do not fit in the socket buffer wait for the reader.
+        reactor r;
+        int fds[2];
+        int rc = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        assert(rc == 0);
+        r.add(fds[0]);
+
+        static char big[1 << 20];
+        memset(big, 'x', sizeof(big));
+        fd_writer writer(r, fds[0]);
+        writer.set_buffer(big, sizeof(big));
+        r.spawn(writer);
+
+        size_t received = 0;
+        int rounds = 0;
+        while (received < sizeof(big)) {
+            r.run_once(0);
+            char buf[65536];
+            ssize_t n = recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT);
+            if (n > 0)
+                received += n;
+            ++rounds;
+        }
+        r.run_once(0);
+        printf("1 MiB written in %d rounds\n", rounds);
+        assert(rounds > 1);
+        assert(received == sizeof(big));
+        assert(r.waiting() == 0);
+
+        r.remove(fds[0]);
+        close(fds[0]);
+        close(fds[1]);
+    }
 
-/// Example two: a coroutine that prints a sequence of numbers. The start value
-/// and the step are passed to the coroutine constructor. Demonstrates coroutine
-/// creation arguments.
-///
-/// Should be able to be called infinitely many times.
+    {
+        // Pipes are no sockets; the writer falls back to `write`.
+        reactor r;
+        int fds[2];
+        int rc = pipe2(fds, O_NONBLOCK);
+        assert(rc == 0);
+        r.add(fds[1]);
+
+        const char text[] = "through a pipe";
+        fd_writer writer(r, fds[1]);
+        writer.set_buffer(text, sizeof(text));
+        r.spawn(writer);
+        r.run();
+
+        char buf[sizeof(text)];
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        assert(n == ssize_t(sizeof(text)));
+        assert(memcmp(buf, text, sizeof(text)) == 0);
+
+        r.remove(fds[1]);
+        close(fds[0]);
+        close(fds[1]);
+    }
 
-/*
-print_counter(int start, int step) : coroutine<void(void)> {
-  for (int i = start; ; i += step) {
-    printf("%d\n, i);
-    yield();
-  }
+    {
+        // Loopback TCP.
+        reactor r;
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        int rc = ::bind(listener, (sockaddr*)&addr, sizeof(addr));
+        assert(rc == 0);
+        rc = listen(listener, 4);
+        assert(rc == 0);
+        getsockname(listener, (sockaddr*)&addr, &len);
+
+        int client_fd = socket(AF_INET, SOCK_STREAM, 0);
+        rc = connect(client_fd, (sockaddr*)&addr, sizeof(addr));
+        assert(rc == 0);
+        int server_fd = accept(listener, nullptr, nullptr);
+        assert(server_fd >= 0);
+        close(listener);
+
+        r.add(server_fd);
+        r.add(client_fd);
+        echo_session session(r, server_fd);
+        echo_client client(r, client_fd, 1000, 64);
+        r.spawn(session);
+        r.spawn(client);
+        r.run();
+        assert(client.completed == 1000);
+        assert(session.done());
+    }
 }
-*/
 
-// Translates to:
-class print_counter : public coroutine<void(void)>
+void test_file_reader()
 {
-public:
-    print_counter(int start, int step)
-        : start(start)
-        , step(step)
-    {}
-
-private:
-    struct coroutine_state {
-        union { int i; };
-    } __state;
+    printf("*** Test file_reader ***\n");
+
+    char path[] = "/tmp/symmetric_coro_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+
+    // 1 MiB and a bit, so that the last block is partial.
+    const size_t size = (1 << 20) + 1234;
+    vector<char> data(size);
+    uint64_t expected_sum = 0;
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = char(i * 7 + i / 4096);
+        expected_sum += (unsigned char)data[i];
+    }
+    ssize_t written = pwrite(fd, data.data(), size, 0);
+    assert(written == ssize_t(size));
+
+    for (auto use : { file_reader::backend::automatic, file_reader::backend::thread_pool }) {
+        for (unsigned depth : { 1u, 4u }) {
+            file_reader::options opts;
+            opts.block_size = 64 * 1024;
+            opts.queue_depth = depth;
+            opts.use = use;
+
+            // Blocking: the consumer is not a coroutine.
+            file_reader reader(fd, opts);
+            size_t offset = 0;
+            int blocks = 0;
+            while (!reader.done()) {
+                span<const char> block = reader.next_chunk();
+                assert(!block.empty());
+                assert(memcmp(block.data(), data.data() + offset, block.size()) == 0);
+                offset += block.size();
+                ++blocks;
+            }
+            printf("%s, depth %u: %d blocks\n", reader.uses_io_uring() ? "io_uring" : "pread pool",
+                   depth, blocks);
+            assert(offset == size);
+            assert(blocks == 17);
+
+            // On a reactor.
+            reactor r;
+            file_reader async_reader(fd, opts, &r);
+            file_checksum checksum(async_reader);
+            r.spawn(checksum);
+            r.run();
+            assert(checksum.done());
+            assert(checksum.size == size);
+            assert(checksum.sum == expected_sum);
+        }
+    }
 
-    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
     {
-        switch (get_suspend_point())
-        {
-        case 0:
-            // Initial suspend point - Save caller
-            process_resume(get_caller(), call_data);
-
-            new (&__state.i) int(start);
-            for (;; __state.i += step) {
-                printf("%d\n", __state.i);
-
-                return prepare_to_suspend(1, get_caller());
-        case 1: // suspend point
-                process_resume(get_caller(), call_data);
-            }
+        // Destroyed with reads in flight.
+        file_reader::options opts;
+        opts.block_size = 4096;
+        opts.queue_depth = 16;
+        file_reader reader(fd, opts);
+        assert(reader.next_chunk().size() == 4096);
+    }
 
-        default:
-            assert(false && "Called a completed coroutine");
-            return {};
-        };
+    for (auto use : { file_reader::backend::automatic, file_reader::backend::thread_pool }) {
+        // Shrunk after opening: the reads come up short and the reader
+        // ends with the part of the file that is left.
+        file_reader::options opts;
+        opts.block_size = 64 * 1024;
+        opts.use = use;
+        file_reader reader(fd, opts);
+        int rc = ftruncate(fd, 100 * 1024);
+        assert(rc == 0);
+        assert(reader.next_chunk().size() == 64 * 1024);
+        span<const char> last = reader.next_chunk();
+        assert(last.size() == 36 * 1024);
+        assert(memcmp(last.data(), data.data() + 64 * 1024, last.size()) == 0);
+        assert(reader.done());
+
+        written = pwrite(fd, data.data(), size, 0);
+        assert(written == ssize_t(size));
     }
 
-    int start;
-    int step;
-};
+    int rc = ftruncate(fd, 0);
+    assert(rc == 0);
+    file_reader empty(fd);
+    assert(empty.next_chunk().empty());
+    assert(empty.done());
+    close(fd);
+}
 
-void test_print_counter()
+void test_instrumentation()
 {
-    printf("*** Test print_counter ***\n");
-    print_counter pc(1, 3);
-
-    assert(!pc.done());
+    printf("*** Test instrumentation ***\n");
+
+    cps_histogram h;
+    for (uint64_t v = 1; v <= 1000; ++v)
+        h.record(v);
+    assert(h.count() == 1000);
+    assert(h.min() == 1 && h.max() == 1000);
+    assert(h.percentile(50) <= 500 && h.percentile(50) >= 500 - 500 / 16);
+    assert(h.percentile(99) <= 990 && h.percentile(99) >= 990 - 990 / 16);
+    assert(h.percentile(0) == h.min() && h.percentile(100) == h.max());
+
+    // Within the recorded range, a percentile is its bucket's lower bound.
+    cps_histogram around;
+    for (uint64_t v : { 900, 1000, 1100 })
+        around.record(v);
+    assert(cps_histogram::lower_bound_of(cps_histogram::index_of(1000)) == 992);
+    assert(around.percentile(50) == 992);
+
+    for (uint64_t v : { 0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, ~0ull }) {
+        uint64_t low = cps_histogram::lower_bound_of(cps_histogram::index_of(v));
+        assert(low <= v && v - low <= v / 16);
+    }
 
-    for (int i = 0; i < 4; ++i) {
-        pc();
-        assert(!pc.done());
+#if CPS_INSTRUMENTATION
+    cps_stats r1_stats("r1"), r2_stats("r2"), m_stats("multiply");
+    {
+        range r1(0, 4);
+        range r2(2, 10);
+        multiply m(r1, r2);
+        r1.set_stats(&r1_stats);
+        r2.set_stats(&r2_stats);
+        m.set_stats(&m_stats);
+
+        while (!m.done())
+            m();
+
+        r1_stats.print();
+        r2_stats.print();
+        m_stats.print();
+
+        // Each product takes three activations of `multiply`: ask r1, ask
+        // r2, yield; every one of them ends in a suspend.
+        assert(m_stats.resumes == 12 && m_stats.suspends == 12);
+        assert(r1_stats.resumes == 4 && r2_stats.resumes == 4);
+        assert(m_stats.trampoline_calls == 4);
+        assert(m_stats.trampoline_hops == 4 * 5);
+        assert(r1_stats.trampoline_calls == 0);
+        assert(m_stats.body_ticks.count() == 12);
     }
 
-    assert(!pc.done());
+    {
+        // One activation in 4 is timed, whichever target it belongs to.
+        r1_stats.reset();
+        r2_stats.reset();
+        m_stats.reset();
+        cps_stats::set_sample_period(4);
+
+        range r1(0, 4);
+        range r2(2, 10);
+        multiply m(r1, r2);
+        r1.set_stats(&r1_stats);
+        r2.set_stats(&r2_stats);
+        m.set_stats(&m_stats);
+        while (!m.done())
+            m();
+
+        assert(m_stats.resumes == 12);
+        assert(r1_stats.body_ticks.count() + r2_stats.body_ticks.count() + m_stats.body_ticks.count() == 5);
+        cps_stats::set_sample_period(1);
+    }
+#endif
 }
 
+void test_tracing()
+{
+    printf("*** Test tracing ***\n");
 
-/*
-print_range(int start, int end) : coroutine<void()>
+#if CPS_TRACING
+    range r1(0, 4);
+    range r2(2, 10);
+    multiply m(r1, r2);
+    cps_trace::set_name(&r1, "r1");
+    cps_trace::set_name(&r2, "r2 \"b\"\\\n");
+    cps_trace::set_name(&m, "multiply");
+
+    cps_trace::start(1024);
+    m();
+    cps_trace::stop();
+    while (!m.done())
+        m();
+
+    // Recording on this thread only; the one call of `m` asks r1, then r2,
+    // then yields: five activations, then the exit.
+    std::vector<cps_trace::record> records;
+    for (auto& thread : cps_trace::records())
+        records.insert(records.end(), thread.begin(), thread.end());
+    assert(records.size() == 6);
+
+    const cps_target* m_target = &m;
+    const cps_target* r1_target = &r1;
+    const cps_target* r2_target = &r2;
+    const cps_target* hops[][2] = {
+        { m_target, nullptr }, { r1_target, m_target }, { m_target, r1_target },
+        { r2_target, m_target }, { m_target, r2_target },
+    };
+    for (int i = 0; i < 5; ++i) {
+        const cps_trace::record& r = records[i];
+        assert(r.what == (i == 0 ? cps_trace::enter : cps_trace::hop));
+        assert(r.callee == hops[i][0] && r.cont == hops[i][1]);
+        assert(i == 0 || r.ticks >= records[i - 1].ticks);
+    }
+    assert(records[0].sp == 0 && records[2].sp == 1 && records[4].sp == 2);
+    assert(records[5].what == cps_trace::exit && records[5].cont == m_target);
+
+    char path[] = "/tmp/symmetric_coro_trace_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    bool written = cps_trace::write_chrome_trace(path);
+    assert(written);
+
+    FILE* in = fopen(path, "r");
+    std::string json;
+    char buf[4096];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), in)) > 0;)
+        json.append(buf, n);
+    fclose(in);
+    unlink(path);
+
+    size_t slices = 0;
+    for (size_t at = 0; (at = json.find("\"ph\":\"X\"", at)) != std::string::npos; ++at)
+        ++slices;
+    assert(slices == 5);
+    assert(json.find("\"name\":\"multiply\"") != std::string::npos);
+    // Names are escaped.
+    assert(json.find("\"from\":\"r2 \\\"b\\\"\\\\\\u000a\"") != std::string::npos);
+    printf("%s", json.c_str());
+#endif
+}
+
+void test_perf_counters()
 {
-  int i = start;
-  for (; i < end - 1; ++i) {
-    printf("%d\n", i);
-    yield();
-  }
-  if (i < end) {
-    printf("%d\n", i);
-  }
+    printf("*** Test perf counters ***\n");
+
+    perf_sample empty;
+    assert(!empty.has(perf_counter::instructions));
+    assert(std::isnan(empty[perf_counter::instructions]) && std::isnan(empty.ipc()));
+
+    perf_counters counters;
+    printf("counters:%s%s%s%s%s%s\n",
+           counters.has(perf_counter::cycles) ? " cycles" : "",
+           counters.has(perf_counter::instructions) ? " instructions" : "",
+           counters.has(perf_counter::branches) ? " branches" : "",
+           counters.has(perf_counter::branch_misses) ? " branch-misses" : "",
+           counters.has(perf_counter::l1d_read_misses) ? " L1d-misses" : "",
+           counters.has(perf_counter::task_clock) ? " task-clock" : "");
+
+    volatile unsigned sink = 0;
+    perf_sample region = counters.measure([&] {
+        for (unsigned i = 0; i < 100000; ++i)
+            sink = sink + i;
+    });
+    for (unsigned c = 0; c < perf_sample::counter_count; ++c)
+        assert(region.has(perf_counter(c)) == counters.has(perf_counter(c)));
+    if (region.has(perf_counter::instructions))
+        assert(region[perf_counter::instructions] >= 100000);
+    if (region.has(perf_counter::task_clock))
+        assert(region[perf_counter::task_clock] > 0);
+
+    // Each product takes five hops; the per-hop counts are about a fifth
+    // of the run's.
+    range r1(0, 4);
+    range r2(2, 10);
+    multiply m(r1, r2);
+    for (int i = 0; i < 3; ++i) {
+        perf_sample hop = counters.measure_run(&m);
+        if (hop.has(perf_counter::instructions))
+            printf("per hop: %.1f instructions, IPC %.2f, %.3f branch misses\n",
+                   hop[perf_counter::instructions], hop.ipc(), hop[perf_counter::branch_misses]);
+        assert(!m.done());
+    }
+    counters.measure_run(&m);
+    assert(m.done());
 }
-*/
 
-// Translates to:
-class print_range : public coroutine<void(void)>
+void test_packed_frame()
 {
-public:
-    print_range(int start, int end)
-        : start(start)
-        , end(end)
-    {}
+    printf("*** Test packed frame ***\n");
+
+    // Slots live across disjoint suspend points share storage; the double
+    // is placed first, as it has the largest alignment.
+    using phased = cps_frame<
+        cps_frame_slot<int, 1, 2>,
+        cps_frame_slot<double, 3>,
+        cps_frame_slot<int, 4>,
+        cps_frame_slot<char, 1, 4>
+    >;
+    static_assert(phased::unpacked_size == 24);
+    static_assert(phased::size == 8);
+    static_assert(phased::offset<1> == 0);
+    static_assert(phased::offset<0> == 0 && phased::offset<2> == 0);
+    static_assert(phased::offset<3> == 4);
+
+    using disjoint = cps_frame<cps_frame_slot<int, 1>, cps_frame_slot<int, 1>, cps_frame_slot<short, 2>>;
+    static_assert(disjoint::size == 8 && disjoint::offset<0> != disjoint::offset<1>);
+    static_assert(disjoint::offset<2> == 0);
 
-private:
-    struct coroutine_state {
-        union { int i; };
-    } __state;
+    {
+        phased f;
+        f.save<1>(2.5);
+        assert(f.get<1>() == 2.5);
+        assert(f.load<1>() == 2.5);
+        f.save<0>(7);
+        f.save<3>('x');
+        assert(f.load<0>() == 7 && f.load<3>() == 'x');
+    }
 
-    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
     {
-        switch (get_suspend_point())
+        struct counted {
+            counted(int& live) : live(&live) { ++live; }
+            counted(counted&& other) : live(other.live) { ++*live; }
+            ~counted() { --*live; }
+            int* live;
+        };
+        int live = 0;
+        cps_frame<cps_frame_slot<counted, 1>> f;
+        f.save<0>(live);
+        assert(live == 1);
         {
-        case 0: // initial suspend point
-            process_resume(get_caller(), call_data);
-            new (&__state.i) int(start);
-            for (; __state.i < end - 1; ++__state.i) {
-                printf("%d\n", __state.i);
-                return prepare_to_suspend(1, get_caller());
-        case 1: // suspend point 1
-                process_resume(get_caller(), call_data);
-            }
-
-            if (__state.i < end) {
-                printf("%d\n", __state.i);
-            }
-
-            return prepare_to_suspend(_sp_done, get_caller());
+            counted c = f.load<0>();
+            assert(live == 1);
+        }
+        assert(live == 0);
+        f.save<0>(live);
+        f.destroy<0>();
+        assert(live == 0);
+    }
 
-        default:
-            assert(false && "Called a completed coroutine");
-            return {};
-        };
+    range r1(0, 4), r2(2, 10);
+    range p1(0, 4), p2(2, 10);
+    multiply m(r1, r2);
+    packed_multiply pm(p1, p2);
+    while (!m.done()) {
+        int product = m();
+        assert(pm() == product);
     }
+    assert(pm.done());
 
-    int start;
-    int end;
-};
+    printf("multiply: %zu bytes, packed_multiply: %zu bytes (frame %zu of %zu)\n",
+           sizeof(multiply), sizeof(packed_multiply),
+           packed_multiply::frame::size, size_t(3 * sizeof(int)));
+    assert(sizeof(packed_multiply) < sizeof(multiply));
+}
 
-void test_print_range()
+void test_compact()
 {
-    printf("*** Test print range ***\n");
-    const int start = 10;
-    const int end = 14;
-    print_range r(start, end);
+    printf("*** Test compact coroutines ***\n");
+    static_assert(sizeof(compact_range) == 20);
 
-    while (!r.done())
-      r();
-}
+    compact_frame_table& table = compact_frame_table::current();
+    const size_t live = table.size();
+
+    range r1(0, 4), r2(2, 10);
+    multiply m(r1, r2);
 
+    compact_handle c1 = table.create<compact_range>(0, 4);
+    compact_handle c2 = table.create<compact_range>(2, 10);
+    compact_handle cm = table.create<compact_multiply>(c1, c2);
+    assert(c1 != c2 && (c1 >> 24) == (c2 >> 24) && (c1 >> 24) != (cm >> 24));
 
-/// Example three: a coroutine which returns a range of numbers. The start
-/// and end value are passed to the coroutine constructor. Demonstrates how
-/// the coroutine produces values.
-///
-/// Should be able to be called (start - end) times.
+    while (!m.done()) {
+        int product = table.resume(cm);
+        printf("%d\n", product);
+        assert(product == m());
+    }
+    assert(table.get<compact_multiply>(cm).done());
+    assert(table.get<compact_range>(c1).done());
+    assert(!table.get<compact_range>(c2).done());
+    assert(table.size() == live + 3);
+
+    // Freed frames are reused, with a fresh object.
+    table.destroy(c2);
+    compact_handle c3 = table.create<compact_range>(5, 7);
+    assert(c3 == c2);
+    assert(int(table.resume(c3)) == 5);
+    assert(int(table.resume(c3)) == 6 && table.get<compact_range>(c3).done());
+
+    table.destroy(c1);
+    table.destroy(c3);
+    table.destroy(cm);
+    assert(table.size() == live);
+}
 
-/*
-range(int start, int end) : coroutine<int()>
+void test_lanes()
 {
-  for (int i = start; i < end - 1; ++i) {
-    yield(i);
-  }
+    printf("*** Test lane coroutines ***\n");
+    constexpr size_t lanes = 4 * lane_width;
+
+    // Lane k multiplies range(k, k + 3 + k % 5) by range(2 * k, 3 * k + 4),
+    // so lanes finish after different numbers of steps.
+    lane_range<lanes> r1, r2;
+    lane_multiply<lanes> m(r1, r2);
+    for (size_t k = 0; k < lanes; ++k) {
+        r1.init(k, k, k + 3 + k % 5);
+        r2.init(k, 2 * k, 3 * k + 4);
+    }
+
+    vector<unique_ptr<range>> s1, s2;
+    vector<unique_ptr<multiply>> sm;
+    for (size_t k = 0; k < lanes; ++k) {
+        s1.push_back(make_unique<range>(k, k + 3 + k % 5));
+        s2.push_back(make_unique<range>(2 * k, 3 * k + 4));
+        sm.push_back(make_unique<multiply>(*s1[k], *s2[k]));
+    }
 
-  return end - 1;
+    lane_int values[lanes / lane_width];
+    size_t steps = 0;
+    while (!m.all_done()) {
+        bool active[lanes];
+        for (size_t k = 0; k < lanes; ++k)
+            active[k] = !m.done(k);
+
+        m.step(values);
+        ++steps;
+        for (size_t k = 0; k < lanes; ++k) {
+            if (!active[k])
+                continue;
+            assert(!sm[k]->done());
+            assert(values[k / lane_width][k % lane_width] == (*sm[k])());
+            assert(m.done(k) == sm[k]->done());
+        }
+    }
+    printf("%zu lanes in %zu steps\n", lanes, steps);
+    assert(steps == 7);
 }
-*/
 
-// Translates to:
-class range : public coroutine<int(void)>
+void test_static_pipeline()
 {
-public:
-    range(int start, int end)
-        : start(start)
-        , end(end)
-    {}
+    printf("*** Test static pipelines ***\n");
+    static_assert(cps_inlinable_v<range> && !cps_inlinable_v<coroutine<int()>>);
 
-private:
-    struct coroutine_state {
-        union { int i; };
-    } __state;
-
-    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
-    {
-        switch (get_suspend_point())
-        {
-        case 0: // initial suspend point
-            process_resume(get_caller(), call_data);
+    range r1(0, 4), r2(2, 10);
+    multiply m(r1, r2);
 
-            for (new (&__state.i) int(start);
-                 __state.i < end - 1;
-                 ++__state.i) {
-                return prepare_to_suspend(1, get_caller(), __state.i);
-        case 1: // suspend point 1
-                process_resume(get_caller(), call_data);
-            }
+    // Fused: the ranges run inside the multiply's body, one hop per value.
+    range f1(0, 4), f2(2, 10);
+    pipeline_multiply<range, range> fused(f1, f2);
 
-            return prepare_to_suspend(_sp_done, get_caller(), end - 1);
+    // Dynamic: the same source, hopping to the ranges.
+    range d1(0, 4), d2(2, 10);
+    pipeline_multiply<coroutine<int()>, coroutine<int()>> dynamic(d1, d2);
 
-        default:
-            assert(false && "Called a completed coroutine");
-            return {};
-        };
+    while (!m.done()) {
+        int product = m();
+        printf("%d\n", product);
+        assert(fused() == product);
+        assert(dynamic() == product);
     }
+    assert(fused.done() && f1.done() && !f2.done());
+    assert(dynamic.done() && d1.done() && !d2.done());
+
+    // Fused pipelines nest: the inner multiply is itself called inline.
+    range n1(1, 5), n2(1, 5), n3(0, 10);
+    pipeline_multiply<range, range> squares(n1, n2);
+    pipeline_multiply<pipeline_multiply<range, range>, range> cubes(squares, n3);
+    for (int i = 1; i < 5; ++i)
+        assert(cubes() == i * i * (i - 1));
+    assert(cubes.done() && squares.done());
+
+    // Called from plain code without a trampoline.
+    range s1(0, 4), s2(2, 10);
+    pipeline_multiply<range, range> direct(s1, s2);
+    for (int i = 0; i < 4; ++i)
+        assert(static_pipeline::call(direct) == i * (i + 2));
+    assert(direct.done());
+}
 
-    int start;
-    int end;
-};
-
-void test_range()
+void test_run_loop()
 {
-    printf("*** Test range ***\n");
-    const int start = 10;
-    const int end = 14;
-    range r(start, end);
+    printf("*** Test run loop ***\n");
+    constexpr int length = 1'000'000;
+
+    // A call through a million relays: two million hops, one trampoline.
+    vector<unique_ptr<chain_relay>> relays;
+    chain_relay* next = nullptr;
+    for (int i = 0; i < length; ++i) {
+        relays.emplace_back(new chain_relay(next));
+        next = relays.back().get();
+    }
 
-    while( !r.done() ) {
-        int val = r();
-        printf("%d\n", val);
+    assert(cps_run_loop::depth() == 0);
+    cps_run_loop::reset_max_depth();
+    assert((*next)() == length - 1);
+    assert((*next)() == length - 1);
+    assert(cps_run_loop::max_depth() == 1);
+
+    // A million starters, each posting the next from its body.
+    int started = 0;
+    vector<unique_ptr<starter>> starters(length);
+    for (int i = length - 1; i >= 0; --i)
+        starters[i].reset(new starter(i + 1 < length ? starters[i + 1].get() : nullptr, started));
+
+    cps_run_loop::reset_max_depth();
+    (*starters[0])();
+    assert(started == length);
+    assert(starters[length - 1]->done());
+    assert(cps_run_loop::max_depth() == 1);
+
+    // Posted from outside any trampoline, a coroutine runs straight away.
+    int inner_started = 0;
+    starter inner(nullptr, inner_started);
+    cps_run_loop::reset_max_depth();
+    cps_run_loop::post(inner);
+    assert(inner_started == 1 && inner.done());
+    assert(cps_run_loop::max_depth() == 1 && cps_run_loop::depth() == 0);
+
+    // A body throwing through a nested and the outermost trampoline puts
+    // the depth back; what it posted runs at the next drain.
+    int late_started = 0;
+    starter late(nullptr, late_started);
+    thrower deep(&late), outer(nullptr, &deep);
+    bool caught = false;
+    try {
+        outer();
+    } catch (const runtime_error&) {
+        caught = true;
     }
+    assert(caught && cps_run_loop::depth() == 0 && late_started == 0);
+
+    // As does one throwing while the queue drains.
+    int after_started = 0;
+    starter after(nullptr, after_started);
+    thrower posted(nullptr);
+    caught = false;
+    try {
+        cps_run_loop::post(posted);
+    } catch (const runtime_error&) {
+        caught = true;
+    }
+    assert(caught && cps_run_loop::depth() == 0 && late_started == 1);
 
-    assert(r.done());
+    cps_run_loop::post(after);
+    assert(after_started == 1 && after.done() && cps_run_loop::depth() == 0);
+    printf("%d relays, %d starters\n", length, started);
 }
 
-/// Example four: a coroutine which returns the values passed to it. Demonstrates
-/// how a coroutine consumes values.
-///
-/// Should be able to be called infinitely many times.
-
-/*
-echo() : coroutine<int(int)>
+// A complete binary tree of the given depth, holding 0, 1, 2... in order.
+static tree_node* build_tree(vector<tree_node>& nodes, int depth, int& next)
 {
-  int val = get_initial_value();
-
-  for (;;) {
-    val = yield(val);
-  }
+    if (depth == 0)
+        return nullptr;
+    tree_node* left = build_tree(nodes, depth - 1, next);
+    tree_node& node = nodes.emplace_back(tree_node{next++, left, nullptr});
+    node.right = build_tree(nodes, depth - 1, next);
+    return &node;
 }
-*/
 
-// Translates to:
-class echo : public coroutine<int(int)>
+void test_yield_from()
 {
-public:
-    echo()
-    {}
+    printf("*** Test yield_from ***\n");
+
+    for (int depth = 1; depth <= 6; ++depth) {
+        vector<tree_node> nodes;
+        nodes.reserve(size_t(1) << depth);
+        int count = 0;
+        tree_node* root = build_tree(nodes, depth, count);
+
+        tree_walk plain(root);
+        delegating_tree_walk delegating(root);
+        for (int i = 0; i < count; ++i) {
+            assert(!plain.done() && !delegating.done());
+            assert(plain() == i);
+            assert(delegating() == i);
+        }
+        assert(plain.done() && delegating.done());
+        printf("depth %d: %d values\n", depth, count);
+    }
 
-private:
-    struct coroutine_state {
-        union { int val; };
-    } __state;
+    // Lopsided trees: only left children, and only right children.
+    vector<tree_node> left_chain(100), right_chain(100);
+    for (int i = 0; i < 100; ++i) {
+        left_chain[i] = {99 - i, i + 1 < 100 ? &left_chain[i + 1] : nullptr, nullptr};
+        right_chain[i] = {i, nullptr, i + 1 < 100 ? &right_chain[i + 1] : nullptr};
+    }
+    delegating_tree_walk lw(&left_chain[0]), rw(&right_chain[0]);
+    for (int i = 0; i < 100; ++i) {
+        assert(lw() == i);
+        assert(rw() == i);
+    }
+    assert(lw.done() && rw.done());
+}
 
-    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
-    {
-        switch (get_suspend_point())
-        {
-        case 0: // initial suspend point - saves the caller and the initial value
-            set_initial_value(process_resume<int>(get_caller(), call_data));
+void test_cxx20_interop()
+{
+    printf("*** Test C++20 interop ***\n");
 
-            new (&__state.val) int(get_initial_value());
+    range r1(0, 4), r2(2, 10);
+    multiply m(r1, r2);
 
-            for (;;) {
-                return prepare_to_suspend(1, get_caller(), __state.val);
+    // A C++20 coroutine awaiting CPS ranges.
+    range a1(0, 4), a2(2, 10);
+    cxx20_generator<int> awaiting = cxx20_multiply(a1, a2);
 
-        case 1:
-                __state.val = process_resume<int>(get_caller(), call_data);
-            }
+    // A CPS coroutine driving C++20 ranges.
+    cxx20_generator<int> c1 = cxx20_range(0, 4), c2 = cxx20_range(2, 10);
+    pipeline_multiply<coroutine<int()>, coroutine<int()>> driving(c1.cps(), c2.cps());
 
-        default:
-            assert(true && "Called a completed coroutine");
-            return {};
-        };
+    while (!m.done()) {
+        int product = m();
+        printf("%d\n", product);
+        assert(awaiting() == product);
+        assert(driving() == product);
     }
-};
-
-void test_echo()
-{
-    printf("*** Test echo ***\n");
-    echo e;
-
-    assert(!e.done());
+    assert(awaiting.done() && a1.done() && !a2.done());
+    assert(driving.done() && c1.done() && !c2.done());
+
+    // Ten thousand relays alternating between the two models, in constant
+    // stack space: each crossing is a hop.
+    constexpr int length = 10'000;
+    auto ones = []() -> cxx20_generator<int> {
+        for (;;)
+            co_yield 1;
+    };
 
-    for (int i = 0; i < 4; ++i) {
-        int response = e(i);
-        printf("%d -> %d\n", i, response);
-        assert(response == i);
-        assert(!e.done());
+    range source(0, 3);
+    vector<cxx20_generator<int>> cxx20_links;
+    vector<unique_ptr<pipeline_multiply<coroutine<int()>, coroutine<int()>>>> cps_links;
+
+    coroutine<int()>* top = &source;
+    for (int i = 0; i < length; ++i) {
+        if (i % 2 == 0) {
+            cxx20_links.push_back(cxx20_relay(*top));
+            top = &cxx20_links.back().cps();
+        } else {
+            // Times one, from a C++20 coroutine too.
+            cxx20_links.push_back(ones());
+            cps_links.emplace_back(new pipeline_multiply<coroutine<int()>, coroutine<int()>>(
+                *top, cxx20_links.back().cps()));
+            top = cps_links.back().get();
+        }
     }
 
-    assert(!e.done());
+    for (int i = 0; i < 3; ++i)
+        assert((*top)() == i + length / 2);
+    assert(top->done());
 }
 
-/// Example five: a coroutine which consumes values from two range coroutines
-/// (provided by the caller) and returns the products of the values. Demonstrates
-/// control flow between coroutines.
 
-/*
-multiply(range& r1, range& r2) : coroutine<int()>
+void test_timer_wheel()
 {
-  assert(!r1.done() && !r2.done());
+    printf("*** Test timer wheel ***\n");
+    using namespace std::chrono;
+
+    // Driven by hand, a tick at a time.
+    timer_wheel w(milliseconds(1));
+    heartbeat fast(w, milliseconds(3), 4), slow(w, milliseconds(5), 2);
+    fast();
+    slow();
+    assert(w.pending() == 2 && fast.get_timer().pending());
+    assert(w.next_timeout_ms(w.now()) == 3);
+
+    for (int tick = 1; tick <= 20; ++tick) {
+        w.advance(w.now() + milliseconds(1));
+        assert(fast.count() == min(tick / 3, 4));
+        assert(slow.count() == min(tick / 5, 2));
+    }
+    assert(fast.done() && slow.done() && w.pending() == 0);
+    assert(fast.get_timer().expired());
+
+    // Deadlines on either side of each level's span fire on their own tick,
+    // whichever level they start in.
+    const int delays[] = {0, 1, 255, 256, 257, 1000, 65535, 65536, 65537, 100000};
+    vector<unique_ptr<heartbeat>> sleepers;
+    for (int delay : delays) {
+        sleepers.emplace_back(new heartbeat(w, milliseconds(delay), 1));
+        (*sleepers.back())();
+    }
 
-  for(;;) {
-    int result = yield(r1() * r2());
+    const auto start = w.now();
+    vector<int> fired(sleepers.size(), -1);
+    while (w.pending() != 0) {
+        w.advance(w.now() + milliseconds(1));
+        for (size_t i = 0; i < sleepers.size(); ++i)
+            if (fired[i] < 0 && sleepers[i]->done())
+                fired[i] = int(duration_cast<milliseconds>(w.now() - start).count());
+    }
+    for (size_t i = 0; i < sleepers.size(); ++i) {
+        printf("slept %d ticks for %d\n", fired[i], delays[i]);
+        assert(fired[i] == max(delays[i], 1));
+    }
 
-    if (!r1.done() && !r2.done())
-      yield(result);
-    else
-      return result;
-  }
+    // And so does one in the top level, cascaded three times.
+    heartbeat far(w, milliseconds(20'000'000), 1);
+    far();
+    w.advance(w.now() + milliseconds(20'000'000 - 1));
+    assert(!far.done());
+    w.advance(w.now() + milliseconds(1));
+    assert(far.done());
+
+    // Cancelled, a sleeper is handed back to be resumed early.
+    heartbeat early(w, milliseconds(100), 2);
+    early();
+    w.advance(w.now() + milliseconds(10));
+    cps_target* sleeper = w.cancel(early.get_timer());
+    assert(sleeper == &early && !early.get_timer().pending() && !early.get_timer().expired());
+    assert(w.cancel(early.get_timer()) == nullptr && w.pending() == 0);
+    cps_run_loop::run(sleeper, {});
+    assert(early.count() == 1 && w.pending() == 1);
+    cps_run_loop::run(w.cancel(early.get_timer()), {});
+    assert(early.done() && early.count() == 2 && w.pending() == 0);
+
+    // In real time.
+    timer_wheel rt(milliseconds(1));
+    heartbeat ticking(rt, milliseconds(2), 3);
+    auto begin = steady_clock::now();
+    ticking();
+    rt.run();
+    assert(ticking.done() && steady_clock::now() - begin >= milliseconds(6));
+    printf("%d beats\n", fast.count() + slow.count() + ticking.count());
 }
-*/
 
-// Translates to:
-class multiply : public coroutine<int()> {
-public:
-    multiply(range& r1, range& r2)
-        : r1(r1)
-        , r2(r2)
-    {}
+template<size_t N>
+void test_channel_pair(int length, bool consumer_first)
+{
+    channel<int, N> ch;
+    channel_range<channel<int, N>> producer(ch, 0, length);
+    channel_sum<channel<int, N>> consumer(ch);
+
+    if (consumer_first) {
+        consumer();
+        assert(!consumer.done() && ch.size() == 0);
+        producer();
+    } else {
+        // The producer fills the buffer, then waits for room unless it fits.
+        producer();
+        assert(producer.done() == (size_t(length) <= N) && ch.size() == min<size_t>(N, length));
+        consumer();
+    }
+    assert(producer.done() && consumer.done() && ch.closed() && ch.size() == 0);
+    assert(consumer.total() == (long long)length * (length - 1) / 2);
+}
 
-private:
-    struct coroutine_state {
-        union { int _temp1; };
-        union { int _temp2; };
-        union { int result; };
-    } __state;
+void test_channel()
+{
+    printf("*** Test channel ***\n");
+
+    // A million values, each handed straight to the waiting consumer, in
+    // constant stack space.
+    constexpr int length = 1'000'000;
+    test_channel_pair<0>(length, true);
+    test_channel_pair<0>(length, false);
+    test_channel_pair<4>(length, true);
+    test_channel_pair<4>(length, false);
+    test_channel_pair<4>(3, false);
+    test_channel_pair<64>(length, false);
+
+    // Non-blocking ends, from plain code.
+    channel<int, 2> ch;
+    int v = 0;
+    assert(ch.try_send(1) && ch.try_send(2) && !ch.try_send(3));
+    assert(ch.try_receive(v) && v == 1 && ch.try_send(3));
+    assert(ch.try_receive(v) && v == 2 && ch.try_receive(v) && v == 3);
+    assert(!ch.try_receive(v) && ch.size() == 0);
+    printf("%d values\n", length);
+}
 
-    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
-    {
-        switch (get_suspend_point())
-        {
-        case 0:
-            process_resume(get_caller(), call_data);
+void test_mapped_records()
+{
+    printf("*** Test mapped records ***\n");
+
+    auto temp_file = [](string_view contents) {
+        char path[] = "/tmp/symmetric_coro_test_XXXXXX";
+        int fd = mkstemp(path);
+        assert(fd >= 0);
+        unlink(path);
+        ssize_t written = pwrite(fd, contents.data(), contents.size(), 0);
+        assert(written == ssize_t(contents.size()));
+        return fd;
+    };
 
-            assert(!r1.done() && !r2.done());
-
-            for (;;) {
-                // _temp1 = r1();
-                return prepare_to_suspend(1, r1.get_cont());
-        case 1:
-                new (&__state._temp1) int(process_resume<int>(r1.get_cont(), call_data));
-
-                // _temp2 = r2();
-                return prepare_to_suspend(2, r2.get_cont());
-        case 2:
-                new (&__state._temp2) int(process_resume<int>(r2.get_cont(), call_data));
-
-                // result = temp1 * temp2;
-                new (&__state.result) int(__state._temp1 * __state._temp2);
-
-                if (!r1.done() && !r2.done()) {
-                    // yield(result);
-                    return prepare_to_suspend(3, get_caller(), __state.result);
-        case 3:
-                    process_resume(get_caller(), call_data);
-                } else {
-                    // yield(result);
-                    return prepare_to_suspend(_sp_done, get_caller(), __state.result);
-                }
-            }
+    auto read_all = [](record_reader& reader) {
+        vector<string> records;
+        while (!reader.done())
+            records.emplace_back(string_view(reader()));
+        return records;
+    };
 
-        default:
-            assert(true && "Called a completed coroutine");
-            return {};
-        };
+    // Lines, with and without a final newline, straight from the mapping.
+    for (bool hugepages : { false, true }) {
+        int fd = temp_file("a,bb,ccc\n\nd\ne,f");
+        mapped_file::options opts;
+        opts.hugepages = hugepages;
+        mapped_file file(fd, opts);
+        close(fd);
+
+        record_reader lines(file);
+        assert(read_all(lines) == vector<string>({"a,bb,ccc", "", "d", "e,f"}));
+
+        // A parser on top: its fields point into the mapping.
+        record_reader records(file);
+        field_splitter fields(records, ',');
+        vector<string> parsed;
+        while (!fields.done()) {
+            string_view field = fields();
+            assert(field.empty() || (field.data() >= file.data() && field.data() < file.data() + file.size()));
+            parsed.emplace_back(field);
+        }
+        assert(parsed == vector<string>({"a", "bb", "ccc", "", "d", "e", "f"}));
+        printf("%zu fields, huge pages %s\n", parsed.size(), file.hugepages() ? "on" : "off");
     }
 
-    range& r1;
-    range& r2;
-};
-
-void test_multiply()
-{
-    printf("*** Test mutiply ***\n");
-    range r1(0, 4);
-    range r2(2, 10);
+    record_reader one_line("x\n");
+    assert(read_all(one_line) == vector<string>({"x"}));
+
+    // Nothing at all.
+    int empty_fd = temp_file("");
+    mapped_file empty(empty_fd);
+    close(empty_fd);
+    record_reader none(empty);
+    assert(none() == string_view() && none.done());
+
+    // Length-prefixed, little-endian; the last one runs past the end.
+    const char prefixed[] = "\x03\0\0\0abc\0\0\0\0\x02\0\0\0hi\x09\0\0\0short";
+    record_reader records(string_view(prefixed, sizeof(prefixed) - 1), record_reader::format::length_prefixed);
+    assert(read_all(records) == vector<string>({"abc", "", "hi", ""}));
+    assert(records.truncated());
+
+    record_reader whole(string_view(prefixed, 17), record_reader::format::length_prefixed);
+    assert(read_all(whole) == vector<string>({"abc", "", "hi"}));
+    assert(!whole.truncated());
+}
 
-    multiply m(r1, r2);
+// An associative, non-commutative reduction that checks the values came
+// in order.
+struct ordered_span {
+    ordered_span(int v) : first(v), last(v) {}
 
-    assert(!m.done());
+    int first;
+    int last;
+    bool in_order = true;
+};
 
-    while (!m.done()) {
-        assert(!r1.done());
-        assert(!r2.done());
+ordered_span operator+(const ordered_span& a, const ordered_span& b)
+{
+    ordered_span r(a.first);
+    r.last = b.last;
+    r.in_order = a.in_order && b.in_order && a.last + 1 == b.first;
+    return r;
+}
 
-        int product = m();
-        printf("%d\n", product);
+void test_parallel_partitions()
+{
+    printf("*** Test parallel partitions ***\n");
+
+    // Splitting hands over the values after the first `keep`.
+    range front(0, 10);
+    range back(front, cps_split, 3);
+    assert(front.size() == 3 && back.size() == 7);
+    for (int i = 0; i < 10; ++i)
+        assert((i < 3 ? front() : back()) == i);
+    assert(front.done() && back.done());
+
+    // Empty and reversed ranges still yield `end - 1`.
+    assert(range(5, 5).size() == 1 && range(7, 3).size() == 1 && range(5, 6).size() == 1);
+
+    constexpr int length = 100'000;
+    constexpr long long expected = (long long)length * (length - 1) / 2;
+    auto add = [](long long a, long long b) { return a + b; };
+
+    partition_options opts;
+    opts.grain = 100;
+
+    for (unsigned workers : { 1u, 4u }) {
+        scheduler s(workers);
+
+        for (merge_order merge : { merge_order::ordered, merge_order::unordered }) {
+            range r(0, length);
+            assert(parallel_reduce(s, r, 0LL, add, merge, opts) == expected);
+        }
+
+        range in_order(0, length);
+        ordered_span span = parallel_reduce(s, in_order, ordered_span(-1), plus<ordered_span>(),
+                                            merge_order::ordered, opts);
+        assert(span.in_order && span.first == -1 && span.last == length - 1);
+
+        atomic<long long> sum{0};
+        atomic<int> count{0};
+        range each(0, length);
+        parallel_for_each(s, each, [&](int v) {
+            sum.fetch_add(v, memory_order_relaxed);
+            count.fetch_add(1, memory_order_relaxed);
+        }, opts);
+        assert(sum.load() == expected && count.load() == length);
+
+        // A zip splits both of its ranges at the same place.
+        zip_multiply zip(0, length, 1, length + 5);
+        assert(zip.size() == size_t(length));
+        long long products = 0;
+        for (long long i = 0; i < length; ++i)
+            products += i * (i + 1);
+        assert(parallel_reduce(s, zip, 0LL, add, merge_order::unordered, opts) == products);
+        printf("%u workers: %lld, %lld\n", workers, expected, products);
     }
-
-    assert(r1.done());
-    assert(!r2.done());
 }
 
 int main()
@@ -921,6 +1598,33 @@ int main()
     test_range();
     test_echo();
     test_multiply();
+    test_cps_arg();
+    test_dot();
+    test_move_echo();
+    test_coroutine_pool();
+    test_frame_arena();
+    test_goto_multiply();
+    test_block_range();
+    test_block_multiply();
+    test_closed_dispatch();
+    test_scheduler();
+    test_handoff();
+    test_reactor();
+    test_file_reader();
+    test_instrumentation();
+    test_tracing();
+    test_perf_counters();
+    test_packed_frame();
+    test_compact();
+    test_lanes();
+    test_static_pipeline();
+    test_run_loop();
+    test_yield_from();
+    test_cxx20_interop();
+    test_timer_wheel();
+    test_channel();
+    test_mapped_records();
+    test_parallel_partitions();
 
     return 0;
 }
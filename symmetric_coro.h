@@ -0,0 +1,1133 @@
+#pragma once
+
+#include <assert.h>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bytes of payload carried inline by every hop, a multiple of 8. With 8 the
+// call data of a hop is returned in two registers. Larger capacities, e.g. 32
+// for four doubles, make every hop return its call data on the stack, which
+// costs several ns per hop.
+#ifndef CPS_ARG_CAPACITY
+#define CPS_ARG_CAPACITY 8
+#endif
+
+// Per-target counters and body timings, see symmetric_coro_stats.h. Off by
+// default, in which case no trace of it is compiled.
+#ifndef CPS_INSTRUMENTATION
+#define CPS_INSTRUMENTATION 0
+#endif
+
+#if CPS_INSTRUMENTATION
+#include "symmetric_coro_stats.h"
+#endif
+
+// Per-thread recording of every hop, see symmetric_coro_trace.h. Off by
+// default.
+#ifndef CPS_TRACING
+#define CPS_TRACING 0
+#endif
+
+#if CPS_TRACING
+#include "symmetric_coro_trace.h"
+#endif
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Low level CPS support
+
+template<class... Ts> class closed_dispatch;
+
+// How a value travels in a hop. Trivially copyable values that fit in the
+// payload are copied. Anything else is passed by address, so the sender
+// must keep it alive until the receiver runs - in practice it lives in the
+// sender's `coroutine_state` or in the caller's argument list. The
+// receiver copies larger trivially copyable values, which may be const,
+// and moves the others out.
+template<class T> struct cps_wire {
+  constexpr static bool by_address = !is_trivially_copyable_v<T> || sizeof(T) > CPS_ARG_CAPACITY;
+  using type = conditional_t<by_address, conditional_t<is_trivially_copyable_v<T>, const T*, T*>, T>;
+
+  template<class U>
+  static type put(U& value) {
+    if constexpr (by_address) {
+      static_assert(!is_const_v<U> || is_trivially_copyable_v<T>,
+                    "Values passed by address must be movable from");
+      return addressof(value);
+    } else {
+      return value;
+    }
+  }
+
+  static T take(type wire) {
+    if constexpr (by_address)
+      return std::move(*wire);
+    else
+      return wire;
+  }
+};
+
+// Trivially copyable layout of several values passed in one hop.
+template<class... Ts> struct cps_pack;
+
+template<> struct cps_pack<> {
+  tuple<> unpack() const { return {}; }
+};
+
+template<class T, class... Ts> struct cps_pack<T, Ts...> {
+  cps_pack() = default;
+
+  cps_pack(typename cps_wire<T>::type head, typename cps_wire<Ts>::type... tail)
+    : head(head)
+    , tail(tail...)
+  {}
+
+  typename cps_wire<T>::type head;
+  [[no_unique_address]] cps_pack<Ts...> tail;
+
+  tuple<T, Ts...> unpack() const {
+    return tuple_cat(tuple<T>(cps_wire<T>::take(head)), tail.unpack());
+  }
+};
+
+template<class T> struct is_tuple : false_type {};
+template<class... Ts> struct is_tuple<tuple<Ts...>> : true_type {};
+
+class cps_target {
+public:
+  // The payload of a hop. Values are stored inline, so they travel with the
+  // call data instead of through memory owned by the sender; see `cps_wire`
+  // for values that are not trivially copyable or do not fit. Several
+  // values, or a `tuple`, are laid out as a `cps_pack` and read back as a
+  // `tuple`.
+  struct cps_arg {
+    constexpr static size_t capacity = CPS_ARG_CAPACITY;
+    static_assert(capacity > 0 && capacity % 8 == 0, "CPS_ARG_CAPACITY must be a multiple of 8");
+
+    // Zeroed, so that the payload of a hop without a value is determinate.
+    cps_arg() = default;
+
+    template<class T>
+      requires (!is_same_v<remove_cvref_t<T>, cps_arg> && !is_tuple<remove_cvref_t<T>>::value)
+    cps_arg(T&& value) {
+      store(cps_wire<remove_cvref_t<T>>::put(value));
+    }
+
+    template<class Tuple> requires is_tuple<remove_cvref_t<Tuple>>::value
+    cps_arg(Tuple&& values) {
+      store(apply([](auto&... v) {
+        return cps_pack<remove_cvref_t<decltype(v)>...>{cps_wire<remove_cvref_t<decltype(v)>>::put(v)...};
+      }, values));
+    }
+
+    template<class T, class... Ts> requires (sizeof...(Ts) > 0)
+    cps_arg(T&& value, Ts&&... values) {
+      store(cps_pack<remove_cvref_t<T>, remove_cvref_t<Ts>...>{
+        cps_wire<remove_cvref_t<T>>::put(value), cps_wire<remove_cvref_t<Ts>>::put(values)...});
+    }
+
+    // Moves the value out of the sender when it travels by address, so each
+    // payload must be read at most once.
+    template<class T> operator T() const { return load(static_cast<T*>(nullptr)); }
+
+  private:
+    template<class T>
+    void store(const T& value) {
+      static_assert(is_trivially_copyable_v<T>, "cps_arg payloads must be trivially copyable");
+      static_assert(sizeof(T) <= capacity, "Payload does not fit in CPS_ARG_CAPACITY");
+      static_assert(alignof(T) <= 8, "Payload is over-aligned");
+      memcpy(_words, &value, sizeof(T));
+    }
+
+    template<class T>
+    T load(T*) const {
+      typename cps_wire<T>::type wire;
+      memcpy(&wire, _words, sizeof(wire));
+      return cps_wire<T>::take(wire);
+    }
+
+    template<class... Ts>
+    tuple<Ts...> load(tuple<Ts...>*) const {
+      return load(static_cast<cps_pack<Ts...>*>(nullptr)).unpack();
+    }
+
+    // Words rather than bytes, so that small payloads stay in registers.
+    unsigned long long _words[capacity / 8] = {};
+  };
+
+  // Packs a continuation and type-erased data
+  struct cps_call_data {
+    cps_arg data;
+    cps_target* cont;
+  };
+
+  // This trampoline simulates tail calls
+  static cps_call_data trampoline(cps_target* target, cps_arg arg) {
+    assert(target != nullptr);
+#if CPS_INSTRUMENTATION
+    cps_stats::trampoline_scope scope(target->_stats);
+#endif
+
+    cps_target* callee = target;
+    cps_arg data = arg;
+    cps_target* cont = nullptr;
+
+    {
+#if CPS_INSTRUMENTATION
+      scope.hop();
+#endif
+#if CPS_TRACING
+      cps_trace::trace(cps_trace::enter, callee, cont, callee->_sp);
+#endif
+      cps_call_data call_data = activate(callee, [&] { return callee->__body({data, cont}); });
+
+      cont = callee;
+      callee = call_data.cont;
+      data = call_data.data;
+    }
+
+    while (callee != nullptr) {
+#if CPS_INSTRUMENTATION
+      scope.hop();
+#endif
+#if CPS_TRACING
+      cps_trace::trace(cps_trace::hop, callee, cont, callee->_sp);
+#endif
+      cps_call_data call_data = activate(callee, [&] { return callee->__body({data, cont}); });
+
+      cont = callee;
+      callee = call_data.cont;
+      data = call_data.data;
+    }
+
+#if CPS_TRACING
+    cps_trace::trace(cps_trace::exit, nullptr, cont, 0);
+#endif
+    return {data, cont};
+  }
+
+  // The coroutine body and current suspend point
+  virtual cps_call_data __body(cps_call_data call_data) = 0;
+
+#if CPS_INSTRUMENTATION
+  // Where this target's activations are recorded; nullptr leaves it
+  // unmeasured.
+  void set_stats(cps_stats* stats) {
+    _stats = stats;
+  }
+
+  cps_stats* get_stats() const {
+    return _stats;
+  }
+#endif
+
+protected:
+  template<class...> friend class closed_dispatch;
+
+  // Runs one activation of `callee`, `body` being its `__body` call.
+  template<class Body>
+  static inline __attribute__((always_inline)) cps_call_data activate(cps_target* callee, Body&& body) {
+#if CPS_INSTRUMENTATION
+    if (cps_stats* stats = callee->_stats)
+      return stats->time_activation(body);
+#else
+    (void)callee;
+#endif
+    return body();
+  }
+
+  // Position of the target's type in the `closed_dispatch` set that adopted
+  // it, starting from 1. Zero means the target is only reachable through the
+  // vtable. Fits in the padding before `_sp`.
+  unsigned short _dispatch_tag = 0;
+
+  // The suspend point of a `coroutine<>`, kept here so that the trampoline
+  // can trace it; always 0 for other targets.
+  int _sp = 0;
+
+#if CPS_INSTRUMENTATION
+  cps_stats* _stats = nullptr;
+#endif
+};
+
+template<class... Ts> class coroutine;
+template<class... Ts> class resume_continuation;
+
+///////////////////////////////////////////////////////////
+// Per-thread run loop - every trampoline that resumes a coroutine
+// from a continuation, or from the scheduler, the reactor or a handoff
+// queue, runs under it, so the thread knows how many trampolines are
+// active.
+//
+// Hops between coroutines are flat, but `c()` called as a plain
+// function from inside a body, rather than rewritten into a suspend
+// point, starts a second trampoline on top of the first, and one more
+// native frame per level for chains of such calls. A body that only
+// wants to start another coroutine, not wait for its result, posts it
+// instead:
+//
+//   cps_run_loop::post(c);   // rather than c();
+//
+// Posted coroutines run one after the other, in order, once the
+// outermost trampoline of the thread has returned - or straight away
+// when none is active. Each starts from the loop at depth 1, so
+// coroutines that post each other run in constant stack space however
+// long the chain. They run through the trampoline the outermost `run`
+// was given, so work posted inside a `closed_dispatch` pipeline stays
+// devirtualized; posted with none active, through the default one. A
+// posted coroutine must not be resumed otherwise before it has run.
+//
+// A body that throws unwinds through the loop, which puts the depth back
+// as it was; what was posted and has not run yet stays queued, to run
+// when the next outermost trampoline returns.
+
+class cps_run_loop {
+public:
+  using cps_arg = cps_target::cps_arg;
+  using cps_call_data = cps_target::cps_call_data;
+
+  // Runs the chain starting at `target` through `trampoline`, by default
+  // `cps_target::trampoline`, and then, if this was the outermost one,
+  // whatever was posted meanwhile.
+  template<class Trampoline>
+  static cps_call_data run(cps_target* target, cps_arg arg, Trampoline&& trampoline) {
+    state& st = _state;
+    if (st.depth != 0)
+      return run_nested(target, arg, trampoline);
+
+    // Constant stores rather than an increment and a decrement, which
+    // would chain consecutive calls through memory.
+    st.depth = 1;
+    cps_call_data call_data = run_at(0, target, arg, trampoline);
+    if (st.posted != 0)
+      drain(trampoline);
+    return call_data;
+  }
+
+  static cps_call_data run(cps_target* target, cps_arg arg) {
+    return run(target, arg, cps_target::trampoline);
+  }
+
+  // Resumes `cont` with `arg` once no trampoline is active on this thread.
+  // `arg` is kept until then, so it must not hold values passed by address
+  // (see `cps_wire`): their sender may be gone by the time it is read.
+  static void post(resume_continuation<>& cont, cps_arg arg = {});
+
+  template<class C, class... Args> requires is_base_of_v<coroutine<>, C>
+  static void post(C& coro, Args&&... args) {
+    static_assert((!cps_wire<remove_cvref_t<Args>>::by_address && ...),
+                  "Posted values must be trivially copyable and fit in CPS_ARG_CAPACITY");
+    post(coro.get_cont(), cps_arg(std::forward<Args>(args)...));
+  }
+
+  // Trampolines active on this thread right now, and the most there have
+  // been at once since the last `reset_max_depth()`, at least 1.
+  static unsigned depth() {
+    return _state.depth;
+  }
+
+  static unsigned max_depth() {
+    return _state.max_depth;
+  }
+
+  static void reset_max_depth() {
+    _state.max_depth = _state.depth > 1 ? _state.depth : 1;
+  }
+
+private:
+  struct posted {
+    resume_continuation<>* cont;
+    cps_arg arg;
+  };
+
+  // Only touched when something is posted, so that `run` itself does
+  // not pay for a thread_local with a destructor.
+  static vector<posted>& queue() {
+    thread_local vector<posted> q;
+    return q;
+  }
+
+  struct state {
+    unsigned depth;
+    unsigned max_depth;
+    size_t posted;
+  };
+
+  // Puts the depth back to `restore` once the trampoline has returned, or
+  // a body has thrown through it.
+  struct depth_guard {
+    unsigned restore;
+
+    ~depth_guard() {
+      _state.depth = restore;
+    }
+  };
+
+  template<class Trampoline>
+  static inline __attribute__((always_inline)) cps_call_data run_at(unsigned restore, cps_target* target,
+                                                                    cps_arg arg, Trampoline& trampoline) {
+    depth_guard guard{restore};
+    return trampoline(target, arg);
+  }
+
+  // Only nested trampolines update `max_depth`, so that the outermost one
+  // does not pay for it.
+  template<class Trampoline>
+  static __attribute__((noinline)) cps_call_data run_nested(cps_target* target, cps_arg arg,
+                                                             Trampoline& trampoline) {
+    state& st = _state;
+    if (++st.depth > st.max_depth)
+      st.max_depth = st.depth;
+    return run_at(st.depth - 1, target, arg, trampoline);
+  }
+
+  template<class Trampoline>
+  static void drain(Trampoline& trampoline);
+
+  static inline thread_local state _state = {0, 1, 0};
+};
+
+
+///////////////////////////////////////////////////////////
+// Resume continuation implementation
+
+template<> class coroutine<>;
+
+template<> class resume_continuation<> {
+  friend class coroutine<>;
+  friend class continuation_handoff;
+  friend struct static_pipeline;
+  friend class cps_run_loop;
+  template<class...> friend class closed_dispatch;
+
+public:
+  bool is_valid() const {
+    return _target != get_invalid_continuation();
+  }
+
+protected:
+  resume_continuation()
+    : _target(get_invalid_continuation()) // An invalidated continuation points to itself
+  {}                // because nullptr is a valid target.
+
+  resume_continuation(cps_target *target)
+    : _target(target)
+  {}
+
+  resume_continuation& operator=(resume_continuation&& other) {
+    if (other.is_valid()) {
+      _target = other._target;
+      other.invalidate();
+    } else {
+      invalidate();
+    }
+
+    return *this;
+  }
+
+  cps_target* release() {
+    cps_target* target = _target;
+    invalidate();
+    return target;
+  }
+
+  void reset(cps_target* new_target) {
+    _target = new_target;
+  }
+
+  template<typename... A>
+  cps_target::cps_arg call_with_trampoline(A&&... args) {
+    cps_target::cps_call_data call_data = cps_run_loop::run(release(), cps_target::cps_arg(args...));
+    reset(call_data.cont);
+    return call_data.data;
+  }
+
+private:
+  class invalid_cps_target : public cps_target {
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override {
+      assert(false && "Invoked invalid continuation");
+      return {{}, nullptr};
+    }
+  };
+
+  static cps_target* get_invalid_continuation() {
+    return reinterpret_cast<invalid_cps_target*>(~0);
+  }
+
+  void invalidate() {
+    _target = get_invalid_continuation();
+  }
+
+  // Should we have this at all??? Should the continuation be a cps_target? I think not...
+  // Maybe instead we should have a helper cps_target for the call with a trampoline.
+  cps_target* _target;
+};
+
+
+
+inline void cps_run_loop::post(resume_continuation<>& cont, cps_arg arg) {
+  assert(cont.is_valid() && "Posted a running coroutine");
+  queue().push_back({&cont, arg});
+  ++_state.posted;
+  if (_state.depth == 0)
+    drain(cps_target::trampoline);
+}
+
+// Runs every posted coroutine, including those posted while draining.
+// Each one's continuation is updated as `call_with_trampoline` would.
+template<class Trampoline>
+void cps_run_loop::drain(Trampoline& trampoline) {
+  vector<posted>& q = queue();
+  size_t head = 0;
+
+  // Drops what has run, also when a body throws.
+  struct consumed_guard {
+    vector<posted>& q;
+    size_t& head;
+
+    ~consumed_guard() {
+      q.erase(q.begin(), q.begin() + head);
+    }
+  } consumed{q, head};
+
+  while (head < q.size()) {
+    posted p = q[head++];
+    --_state.posted;
+
+    _state.depth = 1;
+    cps_call_data call_data = run_at(0, p.cont->release(), p.arg, trampoline);
+    p.cont->reset(call_data.cont);
+  }
+}
+
+///////////////////////////////////////////////////////////
+// End-user resume continuation - type-safe wrappers on top
+// of the type-erased one.
+
+// What a coroutine taking `A...` receives on each resume: the argument
+// itself if there is one, a `tuple` of the arguments otherwise.
+template<class... A> struct cps_value { using type = tuple<A...>; };
+template<class A> struct cps_value<A> { using type = A; };
+template<class... A> using cps_value_t = typename cps_value<A...>::type;
+
+template<> class resume_continuation<void(void)> : public resume_continuation<> {
+public:
+  resume_continuation()
+    : resume_continuation<>()
+  {}
+
+  resume_continuation(cps_target* target)
+    : resume_continuation<>(target)
+  {}
+
+  resume_continuation(coroutine<void()> *c);
+
+  resume_continuation<void(void)>& operator=(resume_continuation<void(void)>&& other) {
+    resume_continuation<>::operator=(std::move(other));
+    return *this;
+  }
+
+  void operator()() {
+    call_with_trampoline();
+  }
+};
+
+template<class R> class resume_continuation<R(void)> : public resume_continuation<> {
+public:
+  resume_continuation()
+    : resume_continuation<>()
+  {}
+
+  resume_continuation(cps_target* target)
+    : resume_continuation<>(target)
+  {}
+
+  resume_continuation(coroutine<R()> *c);
+
+  R operator()() {
+    return call_with_trampoline();
+  }
+};
+
+template<class... A> class resume_continuation<void(A...)> : public resume_continuation<> {
+public:
+  resume_continuation()
+    : resume_continuation<>()
+  {}
+
+  resume_continuation(cps_target* target)
+    : resume_continuation<>(target)
+  {}
+
+  resume_continuation(coroutine<void(A...)> *c);
+
+  void operator()(A... args) {
+    call_with_trampoline(args...);
+  }
+};
+
+template<class R, class... A> class resume_continuation<R(A...)> : public resume_continuation<> {
+public:
+  resume_continuation()
+    : resume_continuation<>()
+  {}
+
+  resume_continuation(cps_target* target)
+    : resume_continuation<>(target)
+  {}
+
+  resume_continuation(coroutine<R(A...)> *c);
+
+  R operator()(A... args) {
+    return call_with_trampoline(args...);
+  }
+};
+
+///////////////////////////////////////////////////////////
+// Base coroutine class - stores just the suspend point.
+
+template<> class coroutine<> : public cps_target {
+public:
+  bool done() const {
+    return _sp == -1;
+  }
+
+protected:
+  // Inside a coroutine body, some invocations get rewritten as follows:
+  //
+  //   1) `coroutine::yield()`   >>>    `get_caller()()`
+  //
+  //   2) `coro()` >>> `coro._cont()`
+  //
+  //   3) `rc()`, where `rc` is a `resume_continuation`   >>>
+  //      ```
+  //        prepare_to_suspend(N, rc);
+  //      case N:
+  //        process_resume(rc, call_data)
+  //      ```
+  //      where `N` is a generated id for the suspend point, unique within this
+  //      coroutine body.
+
+  using suspend_point = int;
+
+  coroutine() = default;
+
+  suspend_point get_suspend_point() const {
+    return _sp;
+  }
+
+  // Alternative to the `switch` on `get_suspend_point()`: a body can keep
+  // the addresses of its resume labels (GNU labels as values) in a table
+  // indexed by suspend point + 1, with the label for a completed coroutine
+  // first, and resume with one indirect jump:
+  //
+  //   static void* const resume_labels[] = { &&done, &&sp0, &&sp1, ... };
+  //   goto *resume_labels[get_resume_index()];
+  //
+  // `_sp` never leaves the table's range, so unlike the jump table of a
+  // `switch` no bounds check is needed. GCC never inlines such a body.
+  unsigned get_resume_index() const {
+    return unsigned(_sp - _sp_done);
+  }
+
+  cps_call_data prepare_to_suspend(suspend_point sp, resume_continuation<>& cont) {
+#if CPS_INSTRUMENTATION
+    if (_stats)
+      ++_stats->suspends;
+#endif
+    _sp = sp;
+    return {{}, cont.release()};
+  }
+
+  // Values passed by address (see `cps_wire`) are read by the receiver
+  // after this body has returned, so they must be lvalues that outlive the
+  // hop, normally members of `coroutine_state`.
+  template<typename ValType>
+  cps_call_data prepare_to_suspend(suspend_point sp, resume_continuation<>& cont, ValType&& val) {
+    static_assert(is_lvalue_reference_v<ValType> || !cps_wire<remove_cvref_t<ValType>>::by_address,
+                  "Yield values passed by address from the coroutine state");
+#if CPS_INSTRUMENTATION
+    if (_stats)
+      ++_stats->suspends;
+#endif
+    _sp = sp;
+    return {{val}, cont.release()};
+  }
+
+  void process_resume(resume_continuation<>& cont, cps_call_data& call_data) {
+    cont.reset(call_data.cont);
+  }
+
+  template<typename ValType>
+  ValType process_resume(resume_continuation<>& cont, cps_call_data& call_data) {
+    cont.reset(call_data.cont);
+    return call_data.data;
+  }
+
+  // In a static pipeline (see `cps_inlinable_v`), `rc()` with `rc` the
+  // continuation of a producer of concrete type `P` calls the producer's
+  // body in place of the hop, and the body carries on at the suspend
+  // point the hop would have come back to:
+  //
+  //   ```
+  //     if constexpr (!cps_inlinable_v<P>)
+  //       return prepare_to_suspend(N, rc);
+  //     else
+  //       call_data = call_inline(producer, rc);
+  //     [[fallthrough]];
+  //   case N:
+  //     process_resume(rc, call_data)
+  //   ```
+  template<class P>
+  cps_call_data call_inline(P& producer, resume_continuation<>& cont, cps_arg arg = {});
+
+  constexpr static suspend_point _sp_done = -1;
+};
+
+///////////////////////////////////////////////////////////
+// Type-safe coroutine classes for user coroutines - add the
+// two resume continuations.
+
+template<> class coroutine<void(void)> : public coroutine<> {
+public:
+ // Always inlined in non-coroutines, injected in coroutine bodies
+  void operator()() {
+    _cont();
+  }
+
+  auto& get_cont() { return _cont; }
+
+protected:
+  coroutine()
+    : _cont(this)
+    , _caller()
+  {}
+
+  // Always inlined
+  void yield() {
+    get_caller()();
+  }
+
+  resume_continuation<void(void)>& get_caller() {
+    return _caller;
+  }
+
+private:
+  resume_continuation<void(void)> _cont;
+  resume_continuation<void(void)> _caller;
+};
+
+inline resume_continuation<void()>::resume_continuation(coroutine<void()> *c)
+  : resume_continuation<>(static_cast<coroutine<>*>(c))
+{}
+
+template<class R> class coroutine<R(void)> : public coroutine<> {
+
+public:
+ // Always inlined in non-coroutines, injected in coroutine bodies
+  R operator()() {
+    return _cont();
+  }
+
+  auto& get_cont() { return _cont; }
+
+protected:
+  coroutine()
+    : _cont(this)
+    , _caller()
+  {}
+
+  // Always inlined
+  void yield(R result) {
+    get_caller()(result);
+  }
+
+  resume_continuation<void(R)>& get_caller() {
+    return _caller;
+  }
+
+private:
+  resume_continuation<R(void)> _cont;
+  resume_continuation<void(R)> _caller;
+};
+
+template<class R>
+resume_continuation<R()>::resume_continuation(coroutine<R()> *c)
+  : resume_continuation<>(static_cast<coroutine<>*>(c))
+{}
+
+template<class... A> class coroutine<void(A...)> : public coroutine<> {
+  using value_type = cps_value_t<A...>;
+
+public:
+ // Always inlined in non-coroutines, injected in coroutine bodies
+  void operator()(A... args) {
+    _cont(std::move(args)...);
+  }
+
+  auto& get_cont() { return _cont; }
+
+protected:
+  coroutine()
+    : _cont(this)
+    , _caller()
+  {}
+
+  // Bodies may read their first arguments without keeping them, so the
+  // initial value only exists once it has been set.
+  ~coroutine() {
+    if (_has_initial_value)
+      _initial_value.~value_type();
+  }
+
+  // Always inlined
+  value_type yield() {
+    return get_caller()();
+  }
+
+  void set_caller(resume_continuation<value_type(void)>&& caller) {
+    _caller = std::move(caller);
+  }
+
+  resume_continuation<value_type(void)>& get_caller() {
+    return _caller;
+  }
+
+  // Called at most once, at the initial suspend point of the body.
+  void set_initial_value(value_type&& value) {
+    assert(!_has_initial_value && "Set the initial value twice");
+    new (&_initial_value) value_type(std::move(value));
+    _has_initial_value = true;
+  }
+
+  value_type& get_initial_value() {
+    return _initial_value;
+  }
+
+  const value_type& get_initial_value() const {
+    return _initial_value;
+  }
+
+private:
+  resume_continuation<void(A...)> _cont;
+  resume_continuation<value_type(void)> _caller;
+
+  union {
+    value_type _initial_value;
+  };
+  bool _has_initial_value = false;
+};
+
+template<class... A>
+resume_continuation<void(A...)>::resume_continuation(coroutine<void(A...)> *c)
+  : resume_continuation<>(static_cast<coroutine<>*>(c))
+{}
+
+template<class R, class... A> class coroutine<R(A...)> : public coroutine<> {
+  using value_type = cps_value_t<A...>;
+
+public:
+  // Always inlined in non-coroutines, injected in coroutine bodies
+  R operator()(A... args) {
+    return _cont(std::move(args)...);
+  }
+
+  auto& get_cont() { return _cont; }
+
+protected:
+  coroutine()
+    : _cont(this)
+    , _caller()
+  {}
+
+  // Bodies may read their first arguments without keeping them, so the
+  // initial value only exists once it has been set.
+  ~coroutine() {
+    if (_has_initial_value)
+      _initial_value.~value_type();
+  }
+
+  // Always inlined
+  value_type yield(R result) {
+    return get_caller()(std::move(result));
+  }
+
+  void set_caller(resume_continuation<value_type(R)>&& caller) {
+    _caller = std::move(caller);
+  }
+
+  resume_continuation<value_type(R)>& get_caller() {
+    return _caller;
+  }
+
+  // Called at most once, at the initial suspend point of the body.
+  void set_initial_value(value_type&& value) {
+    assert(!_has_initial_value && "Set the initial value twice");
+    new (&_initial_value) value_type(std::move(value));
+    _has_initial_value = true;
+  }
+
+  value_type& get_initial_value() {
+    return _initial_value;
+  }
+
+  const value_type& get_initial_value() const {
+    return _initial_value;
+  }
+
+private:
+  resume_continuation<R(A...)> _cont;
+  resume_continuation<value_type(R)> _caller;
+
+  union {
+    value_type _initial_value;
+  };
+  bool _has_initial_value = false;
+};
+
+
+template<class R, class... A>
+resume_continuation<R(A...)>::resume_continuation(coroutine<R(A...)> *c)
+  : resume_continuation<>(static_cast<coroutine<>*>(c))
+{}
+
+///////////////////////////////////////////////////////////
+// Block generators - the body fills a frame-owned buffer and
+// yields how many values it wrote, so one hop delivers up to `N`
+// values and consumers can run tight loops over them.
+//
+// Inside a block generator body, `yield(block)` becomes
+//
+//     fill get_buffer()[0..n)
+//     return prepare_to_suspend(N, get_caller(), n);
+
+template<class T, size_t N> class block_coroutine : public coroutine<int()> {
+public:
+  constexpr static size_t block_size = N;
+
+  // Always inlined in non-coroutines. The block stays valid until the
+  // generator is resumed again.
+  span<const T> next_block() {
+    return get_block((*this)());
+  }
+
+  // The block produced by the resume that returned `count`. Used by
+  // coroutine bodies, which resume the generator through `get_cont()`.
+  span<const T> get_block(int count) const {
+    assert(count >= 0 && size_t(count) <= N);
+    return {_block, size_t(count)};
+  }
+
+protected:
+  span<T, N> get_buffer() {
+    return span<T, N>(_block);
+  }
+
+private:
+  T _block[N];
+};
+
+///////////////////////////////////////////////////////////
+// Closed-world dispatch - when the set of coroutine types that
+// can take part in a chain is known at compile time, each hop
+// switches on the target's `_dispatch_tag` and calls the concrete
+// `__body` directly, so the compiler can inline it. Targets that
+// were not adopted by the set still go through the vtable.
+//
+//   using pipeline = closed_dispatch<range, multiply>;
+//   pipeline::adopt(r1, r2, m);
+//   int product = pipeline::call(m);   // instead of m()
+
+// Generated coroutines befriend this to expose their `__body` to
+// devirtualized dispatchers.
+struct cps_dispatch_access {
+  template<class T>
+  static inline __attribute__((always_inline))
+  cps_target::cps_call_data body(T& target, cps_target::cps_call_data call_data) {
+    return target.T::__body(call_data);
+  }
+
+  // Whether a translation keeps its locals in a `coroutine_state`, and the
+  // bytes it takes, so that frame layouts can be checked against it.
+  template<class T> constexpr static bool has_state = requires { typename T::coroutine_state; };
+
+  template<class T>
+  constexpr static size_t state_size() {
+    if constexpr (is_empty_v<typename T::coroutine_state>)
+      return 0;
+    else
+      return sizeof(typename T::coroutine_state);
+  }
+};
+
+template<class... Ts> class closed_dispatch {
+  static_assert(sizeof...(Ts) > 0 && sizeof...(Ts) < 0xffff,
+                "A closed set needs between 1 and 65534 types");
+
+  using cps_arg = cps_target::cps_arg;
+  using cps_call_data = cps_target::cps_call_data;
+
+public:
+  // Tags `coros` so that closed dispatch recognizes them. A coroutine can be
+  // adopted by at most one set.
+  template<class... Cs>
+  static void adopt(Cs&... coros) {
+    (adopt_one(coros), ...);
+  }
+
+  // Same as `cps_target::trampoline`, with devirtualized hops.
+  static cps_call_data trampoline(cps_target* target, cps_arg arg) {
+    assert(target != nullptr);
+#if CPS_INSTRUMENTATION
+    cps_stats::trampoline_scope scope(target->_stats);
+#endif
+
+    cps_target* callee = target;
+    cps_arg data = arg;
+    cps_target* cont = nullptr;
+
+    do {
+#if CPS_INSTRUMENTATION
+      scope.hop();
+#endif
+#if CPS_TRACING
+      cps_trace::trace(cont ? cps_trace::hop : cps_trace::enter, callee, cont, callee->_sp);
+#endif
+      cps_call_data call_data = cps_target::activate(callee, [&] { return dispatch(callee, {data, cont}); });
+
+      cont = callee;
+      callee = call_data.cont;
+      data = call_data.data;
+    } while (callee != nullptr);
+
+#if CPS_TRACING
+    cps_trace::trace(cps_trace::exit, nullptr, cont, 0);
+#endif
+    return {data, cont};
+  }
+
+  // Same as `resume_continuation<>::call_with_trampoline`.
+  static cps_arg resume(resume_continuation<>& cont, cps_arg arg = {}) {
+    cps_call_data call_data = cps_run_loop::run(cont.release(), arg, trampoline);
+    cont.reset(call_data.cont);
+    return call_data.data;
+  }
+
+  // Same as `coro(args...)`, but every hop of the resulting chain uses
+  // closed dispatch.
+  template<class C, class... A>
+  static auto call(C& coro, A... args) {
+    using R = decltype(coro(args...));
+
+    cps_arg result = resume(coro.get_cont(), cps_arg(args...));
+    if constexpr (!is_void_v<R>) {
+      R value = result;
+      return value;
+    }
+  }
+
+private:
+  template<class T>
+  static constexpr unsigned short tag_of() {
+    unsigned short tag = 0, i = 0;
+    ((++i, tag = (tag == 0 && is_same_v<T, Ts>) ? i : tag), ...);
+    return tag;
+  }
+
+  template<class C>
+  static void adopt_one(C& coro) {
+    constexpr unsigned short tag = tag_of<C>();
+    static_assert(tag != 0, "Coroutine type is not part of the closed set");
+
+    cps_target& target = coro;
+    assert((target._dispatch_tag == 0 || target._dispatch_tag == tag) &&
+           "Coroutine was adopted by another closed set");
+    target._dispatch_tag = tag;
+  }
+
+  // The fold below becomes a switch on the tag.
+  template<size_t... Is>
+  static inline __attribute__((always_inline))
+  cps_call_data dispatch(cps_target* callee, cps_call_data call_data, index_sequence<Is...>) {
+    const unsigned short tag = callee->_dispatch_tag;
+    cps_call_data result;
+
+    bool dispatched =
+      ((tag == Is + 1 &&
+        (result = cps_dispatch_access::body(*static_cast<Ts*>(callee), call_data), true)) || ...);
+
+    if (!dispatched)
+      result = callee->__body(call_data);
+
+    return result;
+  }
+
+  static inline __attribute__((always_inline))
+  cps_call_data dispatch(cps_target* callee, cps_call_data call_data) {
+    return dispatch(callee, call_data, index_sequence_for<Ts...>{});
+  }
+};
+
+///////////////////////////////////////////////////////////
+// Static pipelines - a consumer templated on the types of its
+// producers, e.g. `pipeline_multiply<range, range>`, calls the `__body` of
+// each producer directly instead of hopping to it through the
+// trampoline. The bodies are inlined into the consumer's, and the
+// whole pipeline compiles to one loop. Instantiated with a
+// coroutine interface, e.g. `pipeline_multiply<coroutine<int()>, coroutine<int()>>`,
+// the same consumer hops as usual and works with any producer.
+//
+// A producer is only called inline when its concrete type is known,
+// and then it must suspend back to its caller at every suspend point,
+// as generators do; its own producers may be called inline too.
+//
+// Plain code calls the end of such a pipeline with
+// `static_pipeline::call(m)` instead of `m()`, which skips the trampoline
+// as well and inlines the pipeline into the caller's loop.
+
+template<class P> constexpr bool cps_inlinable_v = !is_abstract_v<P>;
+
+template<class P>
+inline __attribute__((always_inline))
+cps_target::cps_call_data coroutine<>::call_inline(P& producer, resume_continuation<>& cont, cps_arg arg) {
+  static_assert(cps_inlinable_v<P>, "Only producers of a concrete type are called inline");
+  cps_target* callee = cont.release();
+  assert(callee == static_cast<cps_target*>(&producer) && "Continuation is not the producer's");
+
+  cps_call_data call_data = cps_dispatch_access::body(producer, {arg, this});
+  assert(call_data.cont == this && "Producer called inline did not suspend to its caller");
+
+  // What the trampoline would pass back: the value and the producer.
+  return {call_data.data, callee};
+}
+
+struct static_pipeline {
+  // Same as `coro(args...)`, with the body of `coro` called directly. The
+  // body must suspend back to its caller, as for `call_inline`.
+  template<class C, class... A>
+  static inline __attribute__((always_inline)) auto call(C& coro, A... args) {
+    static_assert(cps_inlinable_v<C>, "Only coroutines of a concrete type are called inline");
+    using R = decltype(coro(args...));
+
+    resume_continuation<>& cont = coro.get_cont();
+    cps_target* callee = cont.release();
+    assert(callee == static_cast<cps_target*>(&coro) && "Coroutine is already running");
+
+    cps_target::cps_call_data call_data =
+      cps_dispatch_access::body(coro, {cps_target::cps_arg(args...), nullptr});
+    assert(call_data.cont == nullptr && "Coroutine called inline did not suspend to its caller");
+    cont.reset(callee);
+
+    if constexpr (!is_void_v<R>) {
+      R value = call_data.data;
+      return value;
+    }
+  }
+};
+
+};
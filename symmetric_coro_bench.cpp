@@ -0,0 +1,2166 @@
+// Context-switch benchmarks for the CPS trampoline.
+//
+// Every example coroutine is measured in these flavours:
+//
+//   cps     - the hand-translated `cps_target` coroutine run through
+//             `cps_target::trampoline`
+//   closed  - the same coroutine run through `closed_dispatch`, which
+//             replaces the virtual `__body` call by a switch
+//   cxx20   - the equivalent C++20 coroutine, chained with symmetric
+//             transfer (`await_suspend` returning a `coroutine_handle`)
+//   inline  - the plain loop the compiler would produce if the whole
+//             coroutine graph was inlined
+//
+// Chains are also measured `mixed`, with every other relay a C++20
+// coroutine driven through the trampoline (symmetric_coro_cxx20.h): each
+// hop then crosses between the two models, so ns/hop is the cost of a
+// crossing.
+//
+// Coroutines with many suspend points are also measured with their
+// suspend point dispatched by a `switch` and by a computed goto, `multiply`
+// as a static pipeline with the ranges inlined into it, `multiply` with a
+// frame packed by liveness (`frame_size` lists what packing saves
+// for every example), and `range` / `multiply` with their block versions,
+// where one hop carries a whole block of values. 4096 `multiply`s resumed
+// one after the other are compared with the same 4096 as lane coroutines,
+// stepped a SIMD vector of instances at a time. In-order walks of binary
+// trees of growing depth compare a recursive generator that re-yields
+// every value through each level with one that delegates with
+// `yield_from`. A producer and a consumer joined by a `channel` are
+// compared with a `range` pulled by reference. Ten million idle `range`s
+// on the heap are compared with compact ranges in a frame table by bytes
+// per coroutine and resume throughput.
+//
+// The work-stealing scheduler is measured by its throughput in coroutine
+// steps for 1..N worker threads, as are reductions over `range`s and
+// `zip_multiply`s split into pieces for its workers, and the cross-thread
+// handoff queues by the round-trip latency of a coroutine bouncing between
+// two pinned threads. The reactor runs an echo server over loopback TCP and reports
+// requests per second and p99 latency. `file_reader` is compared with a
+// blocking `read` loop over a file in the page cache, and `record_reader`
+// over a mapped file of CSV lines with `std::getline` over an `ifstream`,
+// for lines and for their fields; the file is `--records-mib` MiB, 256 by
+// default, so pass several thousand for multi-GB files. A timing wheel with
+// a million sleeping coroutines is measured per expiry and per cancel.
+//
+// A hop is one coroutine activation, i.e. one call to `__body` or one
+// `coroutine_handle::resume()`. For the inline flavour the same hop count
+// is used so that `ns/hop` is directly comparable between flavours.
+//
+// Build and run:
+//
+//   g++ -std=c++20 -O2 -pthread symmetric_coro_bench.cpp -o symmetric_coro_bench
+//   ./symmetric_coro_bench [--filter <substr>] [--json <file>]
+//                          [--min-time <seconds>] [--repetitions <n>]
+//                          [--no-perf] [--records-mib <n>]
+//
+// Add -march=native for lane coroutines as wide as the CPU's vectors
+// (16 bytes otherwise).
+//
+// Add -DCPS_ARG_CAPACITY=32 to also measure chains passing 32-byte values,
+// -DCPS_INSTRUMENTATION=1 to measure the cost of the instrumentation, and
+// -DCPS_TRACING=1 for the cost of tracing every hop.
+//
+// Where `perf_event_open` gives access to the PMU, each benchmark runs once
+// more under the hardware counters of the calling thread and also prints
+// instructions, IPC, mispredicted branches and L1d misses per hop. Counters
+// that are not available are left out.
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "symmetric_coro_examples.h"
+#include "symmetric_coro_perf.h"
+#include "symmetric_coro_pool.h"
+
+///////////////////////////////////////////////////////////
+// Benchmark harness
+
+namespace bench {
+
+template<class T>
+inline __attribute__((always_inline)) void do_not_optimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct options {
+  const char* filter = nullptr;
+  const char* json = nullptr;
+  double min_time = 0.05;
+  int repetitions = 3;
+  bool perf = true;
+  size_t records_mib = 256;
+};
+
+struct result {
+  std::string name;
+  std::string impl;
+  std::string payload;
+  int depth;
+  double hops_per_value;
+  uint64_t values;
+  double ns_per_value;
+  double ns_per_hop;
+  double hops_per_sec;
+  // Per hop, from the hardware counters; NaN when not counted.
+  double instructions_per_hop;
+  double ipc;
+  double branch_misses_per_hop;
+  double l1d_misses_per_hop;
+};
+
+static options g_options;
+static std::vector<result> g_results;
+
+// Opened on first use, for the main thread.
+std::perf_counters& perf() {
+  static std::perf_counters counters;
+  return counters;
+}
+
+// Whether `--filter` lets the benchmark named `full_name` run.
+bool selected(const std::string& full_name) {
+  return !g_options.filter || strstr(full_name.c_str(), g_options.filter);
+}
+
+// Times `body(n)`, which must produce `n` values and return a checksum.
+template<class Body>
+double time_once(Body& body, uint64_t n) {
+  auto start = std::chrono::steady_clock::now();
+  do_not_optimize(body(n));
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(stop - start).count();
+}
+
+template<class Body>
+void run(const char* name, const char* impl, const char* payload, int depth,
+         double hops_per_value, Body body) {
+  std::string full_name = std::string(name) + "/" + impl + "/" + payload +
+                          "/depth:" + std::to_string(depth);
+  if (!selected(full_name))
+    return;
+
+  // Grow the value count until one run takes at least `min_time`.
+  uint64_t n = 64;
+  for (;;) {
+    double t = time_once(body, n);
+    if (t >= g_options.min_time)
+      break;
+    double scale = t > 0 ? 1.2 * g_options.min_time / t : 10.0;
+    n = uint64_t(n * std::clamp(scale, 2.0, 10.0));
+  }
+
+  std::vector<double> samples;
+  for (int i = 0; i < g_options.repetitions; ++i)
+    samples.push_back(time_once(body, n) * 1e9 / double(n));
+  std::sort(samples.begin(), samples.end());
+
+  result r;
+  r.name = name;
+  r.impl = impl;
+  r.payload = payload;
+  r.depth = depth;
+  r.hops_per_value = hops_per_value;
+  r.values = n;
+  r.ns_per_value = samples[samples.size() / 2];
+  r.ns_per_hop = r.ns_per_value / hops_per_value;
+  r.hops_per_sec = 1e9 / r.ns_per_hop;
+
+  std::perf_sample counters;
+  if (g_options.perf && perf().available())
+    counters = perf().measure([&] { do_not_optimize(body(n)); }).per(double(n) * hops_per_value);
+  r.instructions_per_hop = counters[std::perf_counter::instructions];
+  r.ipc = counters.ipc();
+  r.branch_misses_per_hop = counters[std::perf_counter::branch_misses];
+  r.l1d_misses_per_hop = counters[std::perf_counter::l1d_read_misses];
+  g_results.push_back(r);
+
+  printf("%-36s hops/value=%-5g ns/value=%8.3f ns/hop=%7.3f Mhops/s=%9.2f",
+         full_name.c_str(), r.hops_per_value, r.ns_per_value, r.ns_per_hop,
+         r.hops_per_sec / 1e6);
+  if (counters.has(std::perf_counter::instructions))
+    printf(" insn/hop=%7.2f", r.instructions_per_hop);
+  if (counters.has(std::perf_counter::cycles) && counters.has(std::perf_counter::instructions))
+    printf(" IPC=%5.2f", r.ipc);
+  if (counters.has(std::perf_counter::branch_misses))
+    printf(" br-miss/hop=%6.3f", r.branch_misses_per_hop);
+  if (counters.has(std::perf_counter::l1d_read_misses))
+    printf(" L1d-miss/hop=%6.3f", r.l1d_misses_per_hop);
+  printf("\n");
+}
+
+// The last result of `name/impl/payload`, if it ran.
+const result* find(const std::string& name, const std::string& impl, const std::string& payload) {
+  for (auto it = g_results.rbegin(); it != g_results.rend(); ++it)
+    if (it->name == name && it->impl == impl && it->payload == payload)
+      return &*it;
+  return nullptr;
+}
+
+// Prints the time per value of `name/impl` as a multiple of that of
+// `name/baseline`, when both ran.
+void report_relative(const char* name, const char* impl, const char* baseline, const char* payload) {
+  const result* r = find(name, impl, payload);
+  const result* b = find(name, baseline, payload);
+  if (!r || !b)
+    return;
+  printf("%-36s x%.3f of %s\n", (std::string(name) + "/" + impl + "/" + payload).c_str(),
+         r->ns_per_value / b->ns_per_value, baseline);
+}
+
+void write_json(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return;
+  }
+
+  // JSON has no NaN; counters that were not counted are null.
+  auto number = [](double v) {
+    char buf[32];
+    if (std::isnan(v))
+      return std::string("null");
+    snprintf(buf, sizeof(buf), "%.4f", v);
+    return std::string(buf);
+  };
+
+  fprintf(f, "[\n");
+  for (size_t i = 0; i < g_results.size(); ++i) {
+    const result& r = g_results[i];
+    fprintf(f,
+            "  {\"name\": \"%s\", \"impl\": \"%s\", \"payload\": \"%s\", "
+            "\"depth\": %d, \"hops_per_value\": %g, \"values\": %llu, "
+            "\"ns_per_value\": %.4f, \"ns_per_hop\": %.4f, "
+            "\"hops_per_sec\": %.1f, \"instructions_per_hop\": %s, \"ipc\": %s, "
+            "\"branch_misses_per_hop\": %s, \"l1d_misses_per_hop\": %s}%s\n",
+            r.name.c_str(), r.impl.c_str(), r.payload.c_str(), r.depth,
+            r.hops_per_value, (unsigned long long)r.values, r.ns_per_value,
+            r.ns_per_hop, r.hops_per_sec, number(r.instructions_per_hop).c_str(),
+            number(r.ipc).c_str(), number(r.branch_misses_per_hop).c_str(),
+            number(r.l1d_misses_per_hop).c_str(),
+            i + 1 == g_results.size() ? "" : ",");
+  }
+  fprintf(f, "]\n");
+  fclose(f);
+}
+
+// A 32-byte payload; only fits in a hop with -DCPS_ARG_CAPACITY=32.
+struct vec4 {
+  double x, y, z, w;
+
+  vec4() = default;
+  vec4(int v) : x(v), y(v), z(v), w(v) {}
+
+  vec4& operator+=(const vec4& other) {
+    x += other.x;
+    y += other.y;
+    z += other.z;
+    w += other.w;
+    return *this;
+  }
+};
+
+template<class T> const char* payload_name();
+template<> const char* payload_name<int>() { return "int"; }
+template<> const char* payload_name<float>() { return "float"; }
+template<> const char* payload_name<double>() { return "double"; }
+template<> const char* payload_name<vec4>() { return "vec4"; }
+
+} // namespace bench
+
+///////////////////////////////////////////////////////////
+// Additional CPS coroutines used to build chains of arbitrary
+// depth and payload type.
+
+/*
+iota<T>(T start, T step) : coroutine<T()>
+{
+  for (T v = start; ; v += step) {
+    yield(v);
+  }
+}
+*/
+
+// Translates to:
+template<class T>
+class iota : public coroutine<T()>
+{
+    friend struct std::cps_dispatch_access;
+
+    using typename coroutine<T()>::cps_call_data;
+
+public:
+    iota(T start, T step)
+        : start(start)
+        , step(step)
+    {}
+
+private:
+    struct coroutine_state {
+        union { T v; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (this->get_suspend_point())
+        {
+        case 0: // initial suspend point
+            this->process_resume(this->get_caller(), call_data);
+
+            for (new (&__state.v) T(start); ; __state.v += step) {
+                return this->prepare_to_suspend(1, this->get_caller(), __state.v);
+        case 1: // suspend point 1
+                this->process_resume(this->get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    T start;
+    T step;
+};
+
+/*
+relay<T>(coroutine<T()>& src) : coroutine<T()>
+{
+  for (;;) {
+    yield(src());
+  }
+}
+*/
+
+// Translates to:
+template<class T>
+class relay : public coroutine<T()>
+{
+    friend struct std::cps_dispatch_access;
+
+    using typename coroutine<T()>::cps_call_data;
+
+public:
+    relay(coroutine<T()>& src)
+        : src(src)
+    {}
+
+private:
+    struct coroutine_state {
+        union { T _temp1; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (this->get_suspend_point())
+        {
+        case 0: // initial suspend point
+            this->process_resume(this->get_caller(), call_data);
+
+            for (;;) {
+                // _temp1 = src();
+                return this->prepare_to_suspend(1, src.get_cont());
+        case 1:
+                new (&__state._temp1) T(this->template process_resume<T>(src.get_cont(), call_data));
+
+                // yield(_temp1);
+                return this->prepare_to_suspend(2, this->get_caller(), __state._temp1);
+        case 2:
+                this->process_resume(this->get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    coroutine<T()>& src;
+};
+
+// The same relay as a C++20 coroutine that takes part in CPS chains; see
+// symmetric_coro_cxx20.h.
+template<class T>
+cxx20_generator<T> interop_relay(coroutine<T()>& src)
+{
+    for (;;)
+        co_yield co_await src;
+}
+
+///////////////////////////////////////////////////////////
+// A coroutine with many suspend points, translated with a
+// `switch` and with computed-goto dispatch.
+
+/*
+octet(int start) : coroutine<int()>
+{
+  for (int i = start; ; i += 8) {
+    yield(i);
+    yield(i + 1);
+    ...
+    yield(i + 7);
+  }
+}
+*/
+
+// Translates to:
+class octet : public coroutine<int()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    octet(int start)
+        : start(start)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int i; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0: // initial suspend point
+            process_resume(get_caller(), call_data);
+
+            for (new (&__state.i) int(start); ; __state.i += 8) {
+                return prepare_to_suspend(1, get_caller(), __state.i);
+        case 1:
+                process_resume(get_caller(), call_data);
+
+                return prepare_to_suspend(2, get_caller(), __state.i + 1);
+        case 2:
+                process_resume(get_caller(), call_data);
+
+                return prepare_to_suspend(3, get_caller(), __state.i + 2);
+        case 3:
+                process_resume(get_caller(), call_data);
+
+                return prepare_to_suspend(4, get_caller(), __state.i + 3);
+        case 4:
+                process_resume(get_caller(), call_data);
+
+                return prepare_to_suspend(5, get_caller(), __state.i + 4);
+        case 5:
+                process_resume(get_caller(), call_data);
+
+                return prepare_to_suspend(6, get_caller(), __state.i + 5);
+        case 6:
+                process_resume(get_caller(), call_data);
+
+                return prepare_to_suspend(7, get_caller(), __state.i + 6);
+        case 7:
+                process_resume(get_caller(), call_data);
+
+                return prepare_to_suspend(8, get_caller(), __state.i + 7);
+        case 8:
+                process_resume(get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    int start;
+};
+
+// Or, with computed-goto dispatch:
+class goto_octet : public coroutine<int()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    goto_octet(int start)
+        : start(start)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int i; };
+    } __state;
+
+    cps_call_data __body(cps_call_data call_data) override
+    {
+        static void* const resume_labels[] = {
+            &&done, &&sp0, &&sp1, &&sp2, &&sp3, &&sp4, &&sp5, &&sp6, &&sp7, &&sp8
+        };
+        goto *resume_labels[get_resume_index()];
+
+    sp0:
+        process_resume(get_caller(), call_data);
+
+        for (new (&__state.i) int(start); ; __state.i += 8) {
+            return prepare_to_suspend(1, get_caller(), __state.i);
+    sp1:
+            process_resume(get_caller(), call_data);
+
+            return prepare_to_suspend(2, get_caller(), __state.i + 1);
+    sp2:
+            process_resume(get_caller(), call_data);
+
+            return prepare_to_suspend(3, get_caller(), __state.i + 2);
+    sp3:
+            process_resume(get_caller(), call_data);
+
+            return prepare_to_suspend(4, get_caller(), __state.i + 3);
+    sp4:
+            process_resume(get_caller(), call_data);
+
+            return prepare_to_suspend(5, get_caller(), __state.i + 4);
+    sp5:
+            process_resume(get_caller(), call_data);
+
+            return prepare_to_suspend(6, get_caller(), __state.i + 5);
+    sp6:
+            process_resume(get_caller(), call_data);
+
+            return prepare_to_suspend(7, get_caller(), __state.i + 6);
+    sp7:
+            process_resume(get_caller(), call_data);
+
+            return prepare_to_suspend(8, get_caller(), __state.i + 7);
+    sp8:
+            process_resume(get_caller(), call_data);
+        }
+
+    done:
+        assert(false && "Called a completed coroutine");
+        return {};
+    }
+
+    int start;
+};
+
+///////////////////////////////////////////////////////////
+// C++20 equivalents. Nested pulls use symmetric transfer in
+// both directions, so a chain never grows the native stack.
+
+namespace cxx20 {
+
+struct transfer_to {
+  std::coroutine_handle<> target;
+
+  bool await_ready() noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept { return target; }
+  void await_resume() noexcept {}
+};
+
+// Pull-style generator; `co_return` produces the last value, like the CPS
+// `range`, after which `done()` is true.
+template<class T> class generator {
+public:
+  struct promise_type {
+    T value{};
+    std::coroutine_handle<> consumer = std::noop_coroutine();
+
+    generator get_return_object() {
+      return generator(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    transfer_to final_suspend() noexcept { return {consumer}; }
+    transfer_to yield_value(T v) noexcept {
+      value = v;
+      return {consumer};
+    }
+    void return_value(T v) noexcept { value = v; }
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  // Awaited from another coroutine: transfers straight into this generator
+  // and back.
+  struct next_awaiter {
+    std::coroutine_handle<promise_type> handle;
+
+    bool await_ready() noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept {
+      handle.promise().consumer = consumer;
+      return handle;
+    }
+    T await_resume() noexcept { return handle.promise().value; }
+  };
+
+  explicit generator(std::coroutine_handle<promise_type> h) : handle(h) {}
+  generator(generator&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+  generator(const generator&) = delete;
+  ~generator() {
+    if (handle)
+      handle.destroy();
+  }
+
+  // Called from ordinary code.
+  T operator()() {
+    handle.promise().consumer = std::noop_coroutine();
+    handle.resume();
+    return handle.promise().value;
+  }
+
+  next_awaiter next() { return {handle}; }
+
+  bool done() const { return handle.done(); }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+};
+
+// Push-pull coroutine: each call passes an argument in and gets a value
+// back, like the CPS `coroutine<int(int)>`.
+template<class T> class echo_coro {
+public:
+  struct promise_type {
+    T value{};
+    T input{};
+
+    echo_coro get_return_object() {
+      return echo_coro(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+
+    struct yield_awaiter {
+      promise_type& p;
+
+      bool await_ready() noexcept { return false; }
+      void await_suspend(std::coroutine_handle<>) noexcept {}
+      T await_resume() noexcept { return p.input; }
+    };
+
+    yield_awaiter yield_value(T v) noexcept {
+      value = v;
+      return {*this};
+    }
+    void return_void() noexcept {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  explicit echo_coro(std::coroutine_handle<promise_type> h) : handle(h) {}
+  echo_coro(const echo_coro&) = delete;
+  ~echo_coro() { handle.destroy(); }
+
+  T operator()(T arg) {
+    handle.promise().input = arg;
+    handle.resume();
+    return handle.promise().value;
+  }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+};
+
+generator<int> yield_once() {
+  co_yield 0;
+  co_return 0;
+}
+
+generator<int> range(int start, int end) {
+  for (int i = start; i < end - 1; ++i)
+    co_yield i;
+  co_return end - 1;
+}
+
+echo_coro<int> echo() {
+  // Primes the coroutine; the first resume delivers the initial value.
+  int val = co_yield 0;
+  for (;;)
+    val = co_yield val;
+}
+
+generator<int> multiply(generator<int>& r1, generator<int>& r2) {
+  for (;;) {
+    int a = co_await r1.next();
+    int b = co_await r2.next();
+    int result = a * b;
+    if (!r1.done() && !r2.done())
+      co_yield result;
+    else
+      co_return result;
+  }
+}
+
+template<class T> generator<T> iota(T start, T step) {
+  for (T v = start; ; v += step)
+    co_yield v;
+}
+
+template<class T> generator<T> relay(generator<T>& src) {
+  for (;;)
+    co_yield co_await src.next();
+}
+
+} // namespace cxx20
+
+///////////////////////////////////////////////////////////
+// Benchmarks of the examples
+
+// Bounded generators are recreated every `chunk` values so that products
+// stay within `int` range and no run depends on the value count.
+constexpr int chunk = 1024;
+
+void bench_yield_once() {
+  // Two hops per coroutine: one to the yield, one to the return.
+  bench::run("yield_once", "cps", "void", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; i += 2) {
+      yield_once yo;
+      yo();
+      yo();
+      sum += yo.done();
+    }
+    return sum;
+  });
+
+  bench::run("yield_once", "cxx20", "void", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; i += 2) {
+      auto yo = cxx20::yield_once();
+      yo();
+      yo();
+      sum += yo.done();
+    }
+    return sum;
+  });
+
+  bench::run("yield_once", "inline", "void", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; i += 2) {
+      bench::do_not_optimize(i);
+      sum += 1;
+    }
+    return sum;
+  });
+}
+
+void bench_range() {
+  bench::run("range", "cps", "int", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      range r(0, chunk);
+      while (!r.done() && i < n) {
+        sum += r();
+        ++i;
+      }
+    }
+    return sum;
+  });
+
+  bench::run("range", "closed", "int", 0, 1, [](uint64_t n) {
+    using pipeline = closed_dispatch<range>;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      range r(0, chunk);
+      pipeline::adopt(r);
+      while (!r.done() && i < n) {
+        sum += pipeline::call(r);
+        ++i;
+      }
+    }
+    return sum;
+  });
+
+  bench::run("range", "cxx20", "int", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      auto r = cxx20::range(0, chunk);
+      while (!r.done() && i < n) {
+        sum += r();
+        ++i;
+      }
+    }
+    return sum;
+  });
+
+  bench::run("range", "inline", "int", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      for (int v = 0; v < chunk && i < n; ++v, ++i) {
+        bench::do_not_optimize(v);
+        sum += v;
+      }
+    }
+    return sum;
+  });
+}
+
+void bench_echo() {
+  bench::run("echo", "cps", "int", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    echo e;
+    for (uint64_t i = 0; i < n; ++i)
+      sum += e(int(i));
+    return sum;
+  });
+
+  bench::run("echo", "closed", "int", 0, 1, [](uint64_t n) {
+    using pipeline = closed_dispatch<echo>;
+    uint64_t sum = 0;
+    echo e;
+    pipeline::adopt(e);
+    for (uint64_t i = 0; i < n; ++i)
+      sum += pipeline::call(e, int(i));
+    return sum;
+  });
+
+  bench::run("echo", "cxx20", "int", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    auto e = cxx20::echo();
+    for (uint64_t i = 0; i < n; ++i)
+      sum += e(int(i));
+    return sum;
+  });
+
+  bench::run("echo", "inline", "int", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      int v = int(i);
+      bench::do_not_optimize(v);
+      sum += v;
+    }
+    return sum;
+  });
+}
+
+void bench_multiply() {
+  // multiply -> r1 -> multiply -> r2 -> multiply
+  const double hops = 5;
+
+  bench::run("multiply", "cps", "int", 2, hops, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      range r1(0, chunk);
+      range r2(0, chunk);
+      multiply m(r1, r2);
+      while (!m.done() && i < n) {
+        sum += m();
+        ++i;
+      }
+    }
+    return sum;
+  });
+
+  bench::run("multiply", "closed", "int", 2, hops, [](uint64_t n) {
+    using pipeline = closed_dispatch<range, multiply>;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      range r1(0, chunk);
+      range r2(0, chunk);
+      multiply m(r1, r2);
+      pipeline::adopt(r1, r2, m);
+      while (!m.done() && i < n) {
+        sum += pipeline::call(m);
+        ++i;
+      }
+    }
+    return sum;
+  });
+
+  // The ranges' bodies inlined into the multiply's: one hop per value
+  // through the trampoline, and none at all through `static_pipeline`.
+  bench::run("multiply", "fused", "int", 2, hops, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      range r1(0, chunk);
+      range r2(0, chunk);
+      pipeline_multiply<range, range> m(r1, r2);
+      while (!m.done() && i < n) {
+        sum += m();
+        ++i;
+      }
+    }
+    return sum;
+  });
+
+  bench::run("multiply", "fused_static", "int", 2, hops, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      range r1(0, chunk);
+      range r2(0, chunk);
+      pipeline_multiply<range, range> m(r1, r2);
+      while (!m.done() && i < n) {
+        sum += static_pipeline::call(m);
+        ++i;
+      }
+    }
+    return sum;
+  });
+
+  bench::run("multiply", "cxx20", "int", 2, hops, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      auto r1 = cxx20::range(0, chunk);
+      auto r2 = cxx20::range(0, chunk);
+      auto m = cxx20::multiply(r1, r2);
+      while (!m.done() && i < n) {
+        sum += m();
+        ++i;
+      }
+    }
+    return sum;
+  });
+
+  bench::run("multiply", "inline", "int", 2, hops, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      for (int a = 0, b = 0; a < chunk && i < n; ++a, ++b, ++i) {
+        bench::do_not_optimize(a);
+        bench::do_not_optimize(b);
+        sum += a * b;
+      }
+    }
+    return sum;
+  });
+}
+
+///////////////////////////////////////////////////////////
+// Suspend-point dispatch: `switch` vs. computed goto
+
+void bench_suspend_dispatch() {
+  const double hops = 5;
+
+  // The `switch` baseline is `multiply/closed`, the same pipeline timed by
+  // `bench_multiply`.
+  bench::run("multiply", "packed", "int", 2, hops, [](uint64_t n) {
+    using pipeline = closed_dispatch<range, packed_multiply>;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      range r1(0, chunk);
+      range r2(0, chunk);
+      packed_multiply m(r1, r2);
+      pipeline::adopt(r1, r2, m);
+      while (!m.done() && i < n) {
+        sum += pipeline::call(m);
+        ++i;
+      }
+    }
+    return sum;
+  });
+
+  bench::run("multiply", "goto", "int", 2, hops, [](uint64_t n) {
+    using pipeline = closed_dispatch<range, goto_multiply>;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      range r1(0, chunk);
+      range r2(0, chunk);
+      goto_multiply m(r1, r2);
+      pipeline::adopt(r1, r2, m);
+      while (!m.done() && i < n) {
+        sum += pipeline::call(m);
+        ++i;
+      }
+    }
+    return sum;
+  });
+  bench::report_relative("multiply", "goto", "closed", "int");
+
+  bench::run("octet", "switch", "int", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    octet o(0);
+    for (uint64_t i = 0; i < n; ++i)
+      sum += o();
+    return sum;
+  });
+
+  bench::run("octet", "goto", "int", 0, 1, [](uint64_t n) {
+    uint64_t sum = 0;
+    goto_octet o(0);
+    for (uint64_t i = 0; i < n; ++i)
+      sum += o();
+    return sum;
+  });
+}
+
+///////////////////////////////////////////////////////////
+// Block generators: one hop per `block_size` values
+
+void bench_blocks() {
+  const double block_hops = 1.0 / block_range::block_size;
+  static_assert(chunk % block_range::block_size == 0);
+
+  bench::run("range", "block", "int", 0, block_hops, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      block_range r(0, chunk);
+      while (!r.done() && i < n) {
+        span<const int> block = r.next_block();
+        for (int v : block)
+          sum += v;
+        i += block.size();
+      }
+    }
+    return sum;
+  });
+
+  bench::run("multiply", "block", "int", 2, 5 * block_hops, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      block_range r1(0, chunk);
+      block_range r2(0, chunk);
+      block_multiply m(r1, r2);
+      while (!m.done() && i < n) {
+        span<const int> block = m.next_block();
+        for (int v : block)
+          sum += v;
+        i += block.size();
+      }
+    }
+    return sum;
+  });
+}
+
+///////////////////////////////////////////////////////////
+// Many instances of one coroutine: one at a time vs. lane-parallel
+
+void bench_lanes() {
+  // 4096 independent `multiply`s over ranges of slightly different
+  // lengths, each stepped in turn until all are done. The scalar flavour
+  // resumes the instances one after the other; the lane flavour steps
+  // `lane_width` of them per body call.
+  static constexpr size_t instances = 4096;
+  const double hops = 5;
+  auto range_end = [](size_t k) { return chunk - int(k % 4); };
+
+  bench::run("multiply_x4096", "cps", "int", 2, hops, [&range_end](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      std::vector<std::unique_ptr<range>> r1, r2;
+      std::vector<std::unique_ptr<multiply>> m;
+      for (size_t k = 0; k < instances; ++k) {
+        r1.emplace_back(new range(0, range_end(k)));
+        r2.emplace_back(new range(0, chunk));
+        m.emplace_back(new multiply(*r1[k], *r2[k]));
+      }
+      for (bool more = true; more && i < n;) {
+        more = false;
+        for (size_t k = 0; k < instances && i < n; ++k) {
+          if (m[k]->done())
+            continue;
+          sum += (*m[k])();
+          more = true;
+          ++i;
+        }
+      }
+    }
+    return sum;
+  });
+
+  bench::run("multiply_x4096", "lanes", "int", 2, hops, [&range_end](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      auto r1 = std::make_unique<lane_range<instances>>();
+      auto r2 = std::make_unique<lane_range<instances>>();
+      auto m = std::make_unique<lane_multiply<instances>>(*r1, *r2);
+      for (size_t k = 0; k < instances; ++k) {
+        r1->init(k, 0, range_end(k));
+        r2->init(k, 0, chunk);
+      }
+      while (!m->all_done() && i < n) {
+        lane_int values = {};
+        for (size_t c = 0; c < instances / lane_width; ++c) {
+          lane_mask active = ~m->done_mask(c);
+          values += m->step(c, active);
+          for (size_t k = 0; k < lane_width; ++k)
+            i -= active[k]; // -1 in the lanes that produced a value
+        }
+        for (size_t k = 0; k < lane_width; ++k)
+          sum += uint32_t(values[k]);
+      }
+    }
+    return sum;
+  });
+}
+
+///////////////////////////////////////////////////////////
+// Recursive generators: re-yielding through every level vs. yield_from
+
+// A complete binary tree of the given depth, values in order.
+static tree_node* build_tree(std::vector<tree_node>& nodes, int depth, int& next) {
+  if (depth == 0)
+    return nullptr;
+  tree_node* left = build_tree(nodes, depth - 1, next);
+  tree_node& node = nodes.emplace_back(tree_node{next++, left, nullptr});
+  node.right = build_tree(nodes, depth - 1, next);
+  return &node;
+}
+
+void bench_tree_walk() {
+  for (int depth : {4, 8, 12, 16, 20}) {
+    if (!bench::selected("tree_walk/cps/int/depth:" + std::to_string(depth)) &&
+        !bench::selected("tree_walk/yield_from/int/depth:" + std::to_string(depth)))
+      continue;
+
+    std::vector<tree_node> nodes;
+    nodes.reserve(size_t(1) << depth);
+    int count = 0;
+    tree_node* root = build_tree(nodes, depth, count);
+
+    // A value from a node at level l (the root being at level 0) takes
+    // 2 * l + 2 hops when re-yielded through every level. With yield_from
+    // each value takes two, plus two per subtree: one to enter it and one
+    // to hand the last value back to its parent.
+    double level_sum = 0;
+    for (int l = 0; l < depth; ++l)
+      level_sum += double(l) * double(size_t(1) << l);
+    const double plain_hops = 2 + 2 * level_sum / count;
+    const double delegating_hops = 2 + 2.0 * (count - 1) / count;
+
+    auto walk = [root, count](auto* tag) {
+      using walker = std::remove_pointer_t<decltype(tag)>;
+      return [root, count](uint64_t n) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < n;) {
+          walker w(root);
+          for (int k = 0; k < count && i < n; ++k, ++i)
+            sum += w();
+        }
+        return sum;
+      };
+    };
+
+    bench::run("tree_walk", "cps", "int", depth, plain_hops, walk((tree_walk*)nullptr));
+    bench::run("tree_walk", "yield_from", "int", depth, delegating_hops, walk((delegating_tree_walk*)nullptr));
+  }
+}
+
+///////////////////////////////////////////////////////////
+// Frame sizes: one slot per local vs. slots packed by liveness
+
+// Frame sizes of the examples with one slot per local, as translated,
+// and packed by liveness. Only `packed_multiply` is translated with a
+// packed frame; for the others the packed object size is derived from
+// the layout.
+template<class C, class Frame>
+void report_frame_size(const char* example) {
+  // The slot lists are written from the pseudo-code; they must take what
+  // the translation's `coroutine_state` does.
+  if constexpr (std::cps_dispatch_access::has_state<C>)
+    static_assert(std::cps_dispatch_access::state_size<C>() == Frame::unpacked_size,
+                  "Frame slots do not match the coroutine_state");
+
+  std::string name = std::string("frame_size/") + example;
+  if (!bench::selected(name))
+    return;
+
+  const size_t packed_object = (sizeof(C) - Frame::unpacked_size + Frame::size + alignof(C) - 1) /
+                               alignof(C) * alignof(C);
+  printf("%-36s state=%3zu -> %3zu bytes  object=%3zu -> %3zu bytes\n", name.c_str(),
+         Frame::unpacked_size, Frame::size, sizeof(C), packed_object);
+}
+
+void report_frame_sizes() {
+  using no_slots = cps_frame<>;
+  using int_across_1 = cps_frame<cps_frame_slot<int, 1>>;
+
+  // The locals of each example and the suspend points they are live
+  // across, from the pseudo-code.
+  report_frame_size<yield_once, no_slots>("yield_once");
+  report_frame_size<print_counter, int_across_1>("print_counter");
+  report_frame_size<print_range, int_across_1>("print_range");
+  report_frame_size<range, int_across_1>("range");
+  report_frame_size<echo, cps_frame<cps_frame_slot<int>>>("echo");
+  report_frame_size<multiply, cps_frame<cps_frame_slot<int, 2>, cps_frame_slot<int>, cps_frame_slot<int>>>(
+    "multiply");
+  report_frame_size<dot, cps_frame<cps_frame_slot<int>, cps_frame_slot<int>, cps_frame_slot<int, 1>>>("dot");
+  report_frame_size<move_echo<std::string>, cps_frame<cps_frame_slot<std::string, 1>>>("move_echo<string>");
+  report_frame_size<goto_multiply, cps_frame<cps_frame_slot<int, 2>, cps_frame_slot<int>, cps_frame_slot<int>>>(
+    "goto_multiply");
+  report_frame_size<block_range, cps_frame<cps_frame_slot<int, 1>, cps_frame_slot<int>>>("block_range");
+  report_frame_size<block_multiply, cps_frame<cps_frame_slot<int, 2>, cps_frame_slot<int>, cps_frame_slot<int>>>(
+    "block_multiply");
+  report_frame_size<scheduled_sum, int_across_1>("scheduled_sum");
+  report_frame_size<shuttle<spsc_handoff_queue<64>>, cps_frame<cps_frame_slot<int, 1, 2>>>("shuttle");
+  report_frame_size<echo_session, cps_frame<cps_frame_slot<ssize_t>>>("echo_session");
+  report_frame_size<echo_client, cps_frame<cps_frame_slot<int, 1, 2>, cps_frame_slot<int, 2>,
+                                           cps_frame_slot<ssize_t>>>("echo_client");
+  report_frame_size<file_checksum, no_slots>("file_checksum");
+  report_frame_size<packed_multiply, packed_multiply::frame>("packed_multiply");
+}
+
+///////////////////////////////////////////////////////////
+// Many idle coroutines: `range` objects on the heap vs. compact ranges in
+// a frame table
+
+void bench_idle_coroutines() {
+  // Ten million suspended ranges, each resumed in turn in a scattered
+  // order, as wake-ups of idle coroutines would come. The stride is prime,
+  // so every coroutine is visited once per round.
+  static constexpr uint32_t count = 10'000'000;
+  static constexpr uint32_t stride = 1'000'003;
+  if (!bench::selected("idle_coroutines/heap/10M/depth:0") &&
+      !bench::selected("idle_coroutines/compact/10M/depth:0"))
+    return;
+
+  auto report = [](const char* impl, double bytes) {
+    printf("%-36s bytes/coroutine=%.1f\n", (std::string("idle_coroutines/") + impl).c_str(), bytes);
+  };
+
+  {
+    size_t heap_before = mallinfo2().uordblks;
+    std::vector<std::unique_ptr<range>> ranges;
+    ranges.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+      ranges.emplace_back(new range(0, INT_MAX));
+    size_t heap_bytes = mallinfo2().uordblks - heap_before - count * sizeof(void*);
+
+    uint32_t pos = 0;
+    bench::run("idle_coroutines", "heap", "10M", 0, 1, [&ranges, &pos](uint64_t n) {
+      uint64_t sum = 0;
+      for (uint64_t i = 0; i < n; ++i) {
+        sum += (*ranges[pos])();
+        pos = (pos + stride) % count;
+      }
+      return sum;
+    });
+    report("heap", double(heap_bytes) / count);
+  }
+
+  {
+    compact_frame_table table;
+    std::vector<compact_handle> handles;
+    handles.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+      handles.push_back(table.create<compact_range>(0, INT_MAX));
+
+    uint32_t pos = 0;
+    bench::run("idle_coroutines", "compact", "10M", 0, 1, [&table, &handles, &pos](uint64_t n) {
+      uint64_t sum = 0;
+      for (uint64_t i = 0; i < n; ++i) {
+        sum += int(table.resume(handles[pos]));
+        pos = (pos + stride) % count;
+      }
+      return sum;
+    });
+    report("compact", double(table.bytes_used()) / count);
+  }
+}
+
+///////////////////////////////////////////////////////////
+// A producer and a consumer over a channel vs. a pulled `range`
+
+template<size_t N> void bench_channel(const char* impl) {
+  // In lockstep every value is handed to the waiting consumer: a hop to
+  // the channel and one to the consumer, and back the same way.
+  bench::run("channel", impl, "int", 0, 4, [](uint64_t n) {
+    std::channel<int, N> ch;
+    channel_range<std::channel<int, N>> producer(ch, 0, int(n));
+    channel_sum<std::channel<int, N>> consumer(ch);
+    consumer();
+    producer();
+    return consumer.total();
+  });
+}
+
+void bench_channels() {
+  bench::run("channel", "pull", "int", 0, 1, [](uint64_t n) {
+    range r(0, int(n));
+    long long total = 0;
+    while (!r.done())
+      total += r();
+    return total;
+  });
+
+  bench_channel<0>("unbuffered");
+  bench_channel<1>("buffered_1");
+  bench_channel<64>("buffered_64");
+}
+
+///////////////////////////////////////////////////////////
+// Spawning short-lived generators: heap vs. pool vs. arena
+
+void bench_spawn() {
+  // One value is one `range` of `length` values created, run to done() and
+  // destroyed.
+  static constexpr int length = 8;
+
+  bench::run("spawn", "heap", "int", 0, length, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      auto r = std::make_unique<range>(0, length);
+      while (!r->done())
+        sum += (*r)();
+    }
+    return sum;
+  });
+
+  bench::run("spawn", "pool", "int", 0, length, [](uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      auto r = coroutine_pool<range>::create(0, length);
+      while (!r->done())
+        sum += (*r)();
+    }
+    return sum;
+  });
+
+  bench::run("spawn", "arena", "int", 0, length, [](uint64_t n) {
+    uint64_t sum = 0;
+    frame_arena arena;
+    for (uint64_t i = 0; i < n; ++i) {
+      range& r = arena.create<range>(0, length);
+      while (!r.done())
+        sum += r();
+      // One request every 64 coroutines.
+      if (i % 64 == 63)
+        arena.release();
+    }
+    return sum;
+  });
+}
+
+///////////////////////////////////////////////////////////
+// Work-stealing scheduler throughput for 1..N workers
+
+/*
+stepper(int steps, int work) : coroutine<void()>
+{
+  for (int i = 0; i < steps; ++i) {
+    for (int k = 0; k < work; ++k)
+      acc = acc * 6364136223846793005 + 1442695040888963407;
+    yield_to_scheduler();
+  }
+}
+*/
+
+// Translates to:
+class stepper : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    stepper(int steps, int work)
+        : steps(steps)
+        , work(work)
+    {}
+
+    uint64_t acc = 1;
+
+private:
+    struct coroutine_state {
+        union { int i; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (new (&__state.i) int(0);
+                 __state.i < steps;
+                 ++__state.i) {
+                for (int k = 0; k < work; ++k)
+                    acc = acc * 6364136223846793005ull + 1442695040888963407ull;
+
+                // yield_to_scheduler();
+                return prepare_to_suspend(1, scheduler::yield_to_scheduler());
+        case 1:
+                ;
+            }
+
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    int steps;
+    int work;
+};
+
+void bench_scheduler() {
+  // One value is one step of one of `tasks` coroutines: the step itself and
+  // the hop into the scheduler that requeues it.
+  static constexpr int tasks = 256;
+
+  std::vector<unsigned> thread_counts;
+  const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned t = 1; t < max_threads; t *= 2)
+    thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  for (int work : {0, 64}) {
+    std::string payload = "work:" + std::to_string(work);
+    for (unsigned threads : thread_counts) {
+      std::string impl = "threads:" + std::to_string(threads);
+      bench::run("scheduler", impl.c_str(), payload.c_str(), 0, 2, [threads, work](uint64_t n) {
+        const int steps = int((n + tasks - 1) / tasks);
+        scheduler s(threads);
+        std::vector<std::unique_ptr<stepper>> steppers;
+        for (int i = 0; i < tasks; ++i) {
+          steppers.push_back(std::make_unique<stepper>(steps, work));
+          s.spawn(*steppers.back());
+        }
+        s.run_until_idle();
+
+        uint64_t sum = 0;
+        for (auto& st : steppers)
+          sum += st->acc;
+        return sum;
+      });
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////
+// Parallel reductions over split `range`s and `zip_multiply`s for 1..N
+// workers
+
+void bench_parallel_reduce() {
+  std::vector<unsigned> thread_counts;
+  const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned t = 1; t < max_threads; t *= 2)
+    thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  auto add = [](long long a, long long b) { return a + b; };
+
+  // The whole sequence on one thread, as the baseline.
+  bench::run("parallel_reduce", "serial", "range", 0, 1, [](uint64_t n) {
+    long long sum = 0;
+    for (uint64_t done = 0; done < n;) {
+      const int length = int(std::min<uint64_t>(n - done, 1 << 30));
+      range r(0, length);
+      while (!r.done())
+        sum += r();
+      done += length;
+    }
+    return sum;
+  });
+
+  // A value of a range is a hop to it and one back; one of a zip adds a
+  // round trip to each of its ranges.
+  for (unsigned threads : thread_counts) {
+    std::string impl = "threads:" + std::to_string(threads);
+    bench::run("parallel_reduce", impl.c_str(), "range", 0, 2, [threads, add](uint64_t n) {
+      std::scheduler s(threads);
+      long long sum = 0;
+      for (uint64_t done = 0; done < n;) {
+        const int length = int(std::min<uint64_t>(n - done, 1 << 30));
+        range r(0, length);
+        sum += std::parallel_reduce(s, r, 0LL, add);
+        done += length;
+      }
+      return sum;
+    });
+
+    bench::run("parallel_reduce", impl.c_str(), "zip", 0, 6, [threads, add](uint64_t n) {
+      std::scheduler s(threads);
+      long long sum = 0;
+      for (uint64_t done = 0; done < n;) {
+        const int length = int(std::min<uint64_t>(n - done, 1 << 30));
+        zip_multiply zip(0, length, 0, length);
+        sum += std::parallel_reduce(s, zip, 0LL, add, std::merge_order::unordered);
+        done += length;
+      }
+      return sum;
+    });
+  }
+}
+
+///////////////////////////////////////////////////////////
+// Cross-thread ping-pong through the handoff queues
+
+// Pins the calling thread to `cpu`, modulo the number of CPUs.
+void pin_to_cpu(unsigned cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % std::max(1u, std::thread::hardware_concurrency()), &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+template<class Queue> void bench_ping_pong(const char* impl) {
+  // One value is one round trip of a `shuttle`: two handoffs, each one
+  // activation of the shuttle and one of the queue's park target.
+  bench::run("ping_pong", impl, "void", 0, 4, [](uint64_t n) {
+    Queue to_a, to_b;
+    std::atomic<bool> finished{false};
+    shuttle<Queue> s(int(n), to_a, to_b, finished);
+
+    auto run = [&finished](Queue& q, unsigned cpu) {
+      pin_to_cpu(cpu);
+      while (!finished.load(std::memory_order_acquire))
+        if (!q.resume_one())
+          std::this_thread::yield();
+    };
+
+    cpu_set_t saved;
+    pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved);
+
+    to_a.push(s);
+    std::thread b(run, std::ref(to_b), 1);
+    run(to_a, 0);
+    b.join();
+
+    pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    return uint64_t(s.visits_a + s.visits_b);
+  });
+}
+
+void bench_handoff() {
+  bench_ping_pong<spsc_handoff_queue<16>>("spsc");
+  bench_ping_pong<mpsc_handoff_queue<16>>("mpsc");
+}
+
+///////////////////////////////////////////////////////////
+// Echo server on the reactor, over loopback TCP
+
+/*
+timed_echo_client(reactor& r, int fd, int requests, vector<uint32_t>& latencies) : coroutine<void()>
+{
+  for (int i = 0; i < requests; ++i) {
+    start = now();
+    write(writer, out, size);
+    for (int received = 0; received < size; received += n)
+      n = read(reader, in + received, size - received);
+    latencies.push_back(now() - start);
+  }
+  r.remove(fd);
+  close(fd);
+}
+*/
+
+// Translates to:
+class timed_echo_client : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    constexpr static int size = 64;
+
+    timed_echo_client(reactor& r, int fd, int requests, std::vector<uint32_t>& latencies)
+        : r(r)
+        , fd(fd)
+        , requests(requests)
+        , latencies(latencies)
+        , reader(r, fd)
+        , writer(r, fd)
+    {
+        memset(out, 'x', size);
+    }
+
+private:
+    struct coroutine_state {
+        union { int i; };
+        union { std::chrono::steady_clock::time_point start; };
+        union { int received; };
+        union { ssize_t n; };
+
+        coroutine_state() {}
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (new (&__state.i) int(0);
+                 __state.i < requests;
+                 ++__state.i) {
+                new (&__state.start) std::chrono::steady_clock::time_point(std::chrono::steady_clock::now());
+
+                writer.set_buffer(out, size);
+                return prepare_to_suspend(1, writer.get_cont());
+        case 1:
+                if (process_resume<ssize_t>(writer.get_cont(), call_data) < 0)
+                    break;
+
+                for (new (&__state.received) int(0);
+                     __state.received < size;
+                     __state.received += __state.n) {
+                    reader.set_buffer(in + __state.received, size - __state.received);
+                    return prepare_to_suspend(2, reader.get_cont());
+        case 2:
+                    new (&__state.n) ssize_t(process_resume<ssize_t>(reader.get_cont(), call_data));
+                    if (__state.n <= 0)
+                        break;
+                }
+                if (__state.received < size)
+                    break;
+
+                latencies.push_back(uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - __state.start).count()));
+            }
+
+            r.remove(fd);
+            close(fd);
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    reactor& r;
+    int fd;
+    int requests;
+    std::vector<uint32_t>& latencies;
+    fd_reader reader;
+    fd_writer writer;
+    char out[size];
+    char in[size];
+};
+
+// A connected pair of loopback TCP sockets, { server, client }.
+std::pair<int, int> loopback_pair() {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (listener < 0 || bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(listener, 1) < 0 || getsockname(listener, (sockaddr*)&addr, &len) < 0) {
+    perror("loopback listener");
+    exit(1);
+  }
+
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  if (client < 0 || connect(client, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("loopback connect");
+    exit(1);
+  }
+  int server = accept(listener, nullptr, nullptr);
+  close(listener);
+
+  int one = 1;
+  setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return { server, client };
+}
+
+void bench_echo_server() {
+  // One value is one 64-byte request echoed back. Every connection keeps
+  // one request in flight, so `connections` is the concurrency.
+  for (int connections : {1, 16, 64}) {
+    std::vector<uint32_t> latencies;
+    std::string impl = "connections:" + std::to_string(connections);
+
+    bench::run("echo_server", impl.c_str(), "64B", 0, 1, [connections, &latencies](uint64_t n) {
+      const int requests = int((n + connections - 1) / connections);
+      latencies.clear();
+      latencies.reserve(size_t(requests) * connections);
+
+      reactor r;
+      std::vector<std::unique_ptr<echo_session>> sessions;
+      std::vector<std::unique_ptr<timed_echo_client>> clients;
+      for (int c = 0; c < connections; ++c) {
+        auto [server, client] = loopback_pair();
+        r.add(server);
+        r.add(client);
+        sessions.push_back(std::make_unique<echo_session>(r, server));
+        clients.push_back(std::make_unique<timed_echo_client>(r, client, requests, latencies));
+        r.spawn(*sessions.back());
+        r.spawn(*clients.back());
+      }
+
+      // Clients close their end when done, which ends the sessions.
+      r.run();
+      return uint64_t(latencies.size());
+    });
+
+    // Latencies of the last repetition.
+    if (!latencies.empty()) {
+      std::sort(latencies.begin(), latencies.end());
+      printf("%-36s requests/s=%.0f p50=%.1fus p99=%.1fus\n", ("echo_server/" + impl).c_str(),
+             1e9 / bench::g_results.back().ns_per_value,
+             latencies[latencies.size() / 2] / 1e3, latencies[latencies.size() * 99 / 100] / 1e3);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////
+// Streaming a file: file_reader vs. a blocking read loop
+
+uint64_t sum_words(const char* data, size_t size) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    sum += word;
+  }
+  return sum;
+}
+
+void bench_file_read() {
+  // One value is one 128 KiB block of a 64 MiB file, read and summed.
+  static constexpr size_t block_size = 128 * 1024;
+  static constexpr size_t file_size = 64 << 20;
+  static constexpr uint64_t file_blocks = file_size / block_size;
+
+  char path[] = "/tmp/symmetric_coro_bench_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return;
+  }
+  unlink(path);
+  {
+    std::vector<char> chunk(block_size);
+    for (size_t i = 0; i < block_size; ++i)
+      chunk[i] = char(i * 31);
+    for (uint64_t b = 0; b < file_blocks; ++b)
+      if (pwrite(fd, chunk.data(), block_size, b * block_size) != ssize_t(block_size)) {
+        perror("pwrite");
+        close(fd);
+        return;
+      }
+  }
+
+  auto report = [] {
+    if (!bench::g_results.empty() && bench::g_results.back().name == "file_read")
+      printf("%-36s MB/s=%.0f\n", ("file_read/" + bench::g_results.back().impl).c_str(),
+             block_size / bench::g_results.back().ns_per_value * 1e3);
+  };
+
+  bench::run("file_read", "blocking", "128KiB", 0, 1, [fd](uint64_t n) {
+    std::vector<char> buf(block_size);
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n;) {
+      lseek(fd, 0, SEEK_SET);
+      for (; i < n; ++i) {
+        ssize_t got = read(fd, buf.data(), block_size);
+        if (got <= 0)
+          break;
+        sum += sum_words(buf.data(), size_t(got));
+      }
+    }
+    return sum;
+  });
+  report();
+
+  for (auto use : {file_reader::backend::io_uring, file_reader::backend::thread_pool}) {
+    for (unsigned depth : {1u, 4u, 16u}) {
+      file_reader::options opts;
+      opts.block_size = block_size;
+      opts.queue_depth = depth;
+      opts.use = use;
+
+      std::string impl = std::string(use == file_reader::backend::io_uring ? "io_uring" : "pread_pool") +
+                         ":qd" + std::to_string(depth);
+      try {
+        bench::run("file_read", impl.c_str(), "128KiB", 0, 1, [fd, &opts](uint64_t n) {
+          uint64_t sum = 0;
+          for (uint64_t i = 0; i < n;) {
+            file_reader reader(fd, opts);
+            for (; i < n && !reader.done(); ++i) {
+              std::span<const char> block = reader.next_chunk();
+              sum += sum_words(block.data(), block.size());
+            }
+          }
+          return sum;
+        });
+        report();
+      } catch (const std::system_error& e) {
+        printf("file_read/%s: skipped (%s)\n", impl.c_str(), e.what());
+      }
+    }
+  }
+
+  close(fd);
+}
+
+///////////////////////////////////////////////////////////
+// Lines and fields of a mapped file vs. `std::getline`
+
+void bench_records() {
+  const char* impls[] = {"getline", "mapped", "mapped_hugepages"};
+  bool any = false;
+  for (const char* impl : impls)
+    for (const char* payload : {"lines", "fields"})
+      any |= bench::selected(std::string("records/") + impl + "/" + payload + "/depth:0");
+  if (!any)
+    return;
+
+  // CSV lines of three numbers, about 20 bytes each.
+  char path[] = "/tmp/symmetric_coro_bench_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return;
+  }
+  const size_t target = bench::g_options.records_mib << 20;
+  size_t file_size = 0;
+  uint64_t line_count = 0;
+  {
+    std::string chunk;
+    uint32_t seed = 1;
+    while (file_size < target) {
+      chunk.clear();
+      while (chunk.size() < (1 << 20)) {
+        char line[64];
+        uint32_t a = seed = seed * 1664525 + 1013904223;
+        uint32_t b = seed = seed * 1664525 + 1013904223;
+        chunk.append(line, size_t(snprintf(line, sizeof(line), "%u,%u,%u\n", a >> 12, b >> 20, a ^ b)));
+        ++line_count;
+      }
+      if (write(fd, chunk.data(), chunk.size()) != ssize_t(chunk.size())) {
+        perror("write");
+        close(fd);
+        unlink(path);
+        return;
+      }
+      file_size += chunk.size();
+    }
+  }
+  const double bytes_per_line = double(file_size) / double(line_count);
+
+  auto report = [bytes_per_line] {
+    const bench::result& r = bench::g_results.back();
+    printf("%-36s MB/s=%.0f\n", ("records/" + r.impl + "/" + r.payload).c_str(),
+           bytes_per_line / r.ns_per_value * 1e3);
+  };
+
+  // A value is one line: its fields are counted and their bytes summed.
+  auto fields_of = [](std::string_view line, uint64_t& sum) {
+    for (size_t k; (k = line.find(',')) != std::string_view::npos; line.remove_prefix(k + 1))
+      sum += k + 1;
+    sum += line.size() + 1;
+  };
+
+  for (const char* payload : {"lines", "fields"}) {
+    const bool fields = payload[0] == 'f';
+    const size_t before = bench::g_results.size();
+    bench::run("records", "getline", payload, 0, 1, [&](uint64_t n) {
+      uint64_t sum = 0;
+      std::string line;
+      for (uint64_t i = 0; i < n;) {
+        std::ifstream in(path);
+        for (; i < n && std::getline(in, line); ++i) {
+          if (fields)
+            fields_of(line, sum);
+          else
+            sum += line.size();
+        }
+      }
+      return sum;
+    });
+    if (bench::g_results.size() != before)
+      report();
+
+    for (bool hugepages : {false, true}) {
+      const char* impl = hugepages ? "mapped_hugepages" : "mapped";
+      std::mapped_file::options opts;
+      opts.hugepages = hugepages;
+      const size_t before = bench::g_results.size();
+      // Fields come from a `field_splitter` chained on the reader, one hop
+      // per field on top of one per line.
+      bench::run("records", impl, payload, 0, fields ? 4 : 1, [&](uint64_t n) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < n;) {
+          std::mapped_file file(fd, opts);
+          std::record_reader reader(file);
+          if (fields) {
+            // Three fields to a line.
+            field_splitter splitter(reader, ',');
+            for (int field = 0; i < n && !splitter.done();) {
+              sum += std::string_view(splitter()).size() + 1;
+              if (++field == 3) {
+                field = 0;
+                ++i;
+              }
+            }
+          } else {
+            for (; i < n && !reader.done(); ++i)
+              sum += std::string_view(reader()).size();
+          }
+        }
+        return sum;
+      });
+      if (bench::g_results.size() != before)
+        report();
+    }
+  }
+
+  close(fd);
+  unlink(path);
+}
+
+///////////////////////////////////////////////////////////
+// A million heartbeats sleeping on a timing wheel
+
+void bench_timers() {
+  // Intervals spread over 1..4096 ticks, so that most timers start in the
+  // second level and are cascaded once. Time is advanced by hand, a tick
+  // at a time. A value is one timer expiring, or one cancelled, with the
+  // heartbeat resumed and asleep again: a hop to it and a hop to its timer.
+  static constexpr int count = 1'000'000;
+  if (!bench::selected("timer_wheel/expire/1M/depth:0") &&
+      !bench::selected("timer_wheel/cancel/1M/depth:0"))
+    return;
+
+  std::timer_wheel w(std::chrono::milliseconds(1));
+  std::vector<std::unique_ptr<heartbeat>> beats;
+  beats.reserve(count);
+  uint32_t seed = 1;
+  for (int i = 0; i < count; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    beats.emplace_back(new heartbeat(w, std::chrono::milliseconds(1 + (seed >> 20)), INT_MAX));
+    (*beats.back())();
+  }
+
+  bench::run("timer_wheel", "expire", "1M", 0, 2, [&w](uint64_t n) {
+    uint64_t resumed = 0;
+    while (resumed < n)
+      resumed += w.advance(w.now() + w.tick());
+    return resumed;
+  });
+
+  // Scattered, as early wake-ups would come; the stride is prime.
+  uint32_t pos = 0;
+  bench::run("timer_wheel", "cancel", "1M", 0, 2, [&w, &beats, &pos](uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) {
+      std::cps_run_loop::run(w.cancel(beats[pos]->get_timer()), {});
+      pos = (pos + 1'000'003) % count;
+    }
+    return w.pending();
+  });
+
+  for (auto& beat : beats)
+    w.cancel(beat->get_timer());
+}
+
+///////////////////////////////////////////////////////////
+// Chains of `relay`s on top of an `iota` source
+
+template<class T> void bench_chain(int depth) {
+  // The request goes down through every relay to the source and the value
+  // comes back up through every relay.
+  const double hops = 2 * depth + 1;
+  const char* payload = bench::payload_name<T>();
+
+  bench::run("chain", "cps", payload, depth, hops, [depth](uint64_t n) {
+    iota<T> source(T(0), T(1));
+    std::vector<std::unique_ptr<relay<T>>> relays;
+    coroutine<T()>* top = &source;
+    for (int d = 0; d < depth; ++d) {
+      relays.push_back(std::make_unique<relay<T>>(*top));
+      top = relays.back().get();
+    }
+
+    T sum{};
+    for (uint64_t i = 0; i < n; ++i)
+      sum += (*top)();
+    return sum;
+  });
+
+  // Every other relay a C++20 coroutine, so that each hop crosses from
+  // one model to the other.
+  bench::run("chain", "mixed", payload, depth, hops, [depth](uint64_t n) {
+    iota<T> source(T(0), T(1));
+    std::vector<std::unique_ptr<relay<T>>> relays;
+    std::vector<cxx20_generator<T>> interop_relays;
+    coroutine<T()>* top = &source;
+    for (int d = 0; d < depth; ++d) {
+      if (d % 2 == 0) {
+        interop_relays.push_back(interop_relay<T>(*top));
+        top = &interop_relays.back().cps();
+      } else {
+        relays.push_back(std::make_unique<relay<T>>(*top));
+        top = relays.back().get();
+      }
+    }
+
+    T sum{};
+    for (uint64_t i = 0; i < n; ++i)
+      sum += (*top)();
+    return sum;
+  });
+
+  bench::run("chain", "closed", payload, depth, hops, [depth](uint64_t n) {
+    using pipeline = closed_dispatch<iota<T>, relay<T>>;
+    iota<T> source(T(0), T(1));
+    pipeline::adopt(source);
+    std::vector<std::unique_ptr<relay<T>>> relays;
+    coroutine<T()>* top = &source;
+    for (int d = 0; d < depth; ++d) {
+      relays.push_back(std::make_unique<relay<T>>(*top));
+      pipeline::adopt(*relays.back());
+      top = relays.back().get();
+    }
+
+    T sum{};
+    for (uint64_t i = 0; i < n; ++i)
+      sum += pipeline::call(*top);
+    return sum;
+  });
+
+  bench::run("chain", "cxx20", payload, depth, hops, [depth](uint64_t n) {
+    std::vector<cxx20::generator<T>> stages;
+    stages.reserve(depth + 1);
+    stages.push_back(cxx20::iota<T>(T(0), T(1)));
+    for (int d = 0; d < depth; ++d)
+      stages.push_back(cxx20::relay<T>(stages.back()));
+
+    T sum{};
+    for (uint64_t i = 0; i < n; ++i)
+      sum += stages.back()();
+    return sum;
+  });
+
+  bench::run("chain", "inline", payload, depth, hops, [](uint64_t n) {
+    T sum{};
+    T v{};
+    for (uint64_t i = 0; i < n; ++i, v += T(1)) {
+      bench::do_not_optimize(v);
+      sum += v;
+    }
+    return sum;
+  });
+}
+
+#if CPS_INSTRUMENTATION
+void bench_instrumentation() {
+  // A depth-4 chain of ints with instrumentation compiled in: without
+  // stats attached, with every activation timed, and with 1 in 64 timed.
+  static constexpr int depth = 4;
+  const double hops = 2 * depth + 1;
+
+  for (unsigned period : {0u, 1u, 64u}) {
+    std::string impl = period == 0 ? "stats:none" : "stats:1/" + std::to_string(period);
+    bench::run("instrumented_chain", impl.c_str(), "int", depth, hops, [period](uint64_t n) {
+      std::vector<cps_stats> stats(depth + 1);
+      iota<int> source(0, 1);
+      std::vector<std::unique_ptr<relay<int>>> relays;
+      coroutine<int()>* top = &source;
+      for (int d = 0; d < depth; ++d) {
+        relays.push_back(std::make_unique<relay<int>>(*top));
+        top = relays.back().get();
+      }
+      if (period) {
+        cps_stats::set_sample_period(period);
+        source.set_stats(&stats[0]);
+        for (int d = 0; d < depth; ++d)
+          relays[d]->set_stats(&stats[d + 1]);
+      }
+
+      int sum = 0;
+      for (uint64_t i = 0; i < n; ++i)
+        sum += (*top)();
+      return sum;
+    });
+  }
+  cps_stats::set_sample_period(1);
+}
+#endif
+
+#if CPS_TRACING
+void bench_tracing() {
+  // The same depth-4 chain of ints with tracing compiled in, stopped and
+  // recording. The rings wrap, so only the recording itself is measured.
+  static constexpr int depth = 4;
+  const double hops = 2 * depth + 1;
+
+  for (bool recording : {false, true}) {
+    bench::run("traced_chain", recording ? "trace:on" : "trace:off", "int", depth, hops, [recording](uint64_t n) {
+      iota<int> source(0, 1);
+      std::vector<std::unique_ptr<relay<int>>> relays;
+      coroutine<int()>* top = &source;
+      for (int d = 0; d < depth; ++d) {
+        relays.push_back(std::make_unique<relay<int>>(*top));
+        top = relays.back().get();
+      }
+
+      if (recording)
+        cps_trace::start();
+      int sum = 0;
+      for (uint64_t i = 0; i < n; ++i)
+        sum += (*top)();
+      cps_trace::stop();
+      return sum;
+    });
+  }
+}
+#endif
+
+template<class T> void bench_chains() {
+  for (int depth : {0, 1, 2, 4, 8, 16})
+    bench_chain<T>(depth);
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            bench::g_options.filter = argv[++i];
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            bench::g_options.json = argv[++i];
+        } else if (!strcmp(argv[i], "--min-time") && i + 1 < argc) {
+            bench::g_options.min_time = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--repetitions") && i + 1 < argc) {
+            bench::g_options.repetitions = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--no-perf")) {
+            bench::g_options.perf = false;
+        } else if (!strcmp(argv[i], "--records-mib") && i + 1 < argc) {
+            bench::g_options.records_mib = std::max(1, atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "usage: %s [--filter <substr>] [--json <file>] "
+                            "[--min-time <seconds>] [--repetitions <n>] [--no-perf] "
+                            "[--records-mib <n>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bench_yield_once();
+    bench_range();
+    bench_echo();
+    bench_multiply();
+    bench_suspend_dispatch();
+    bench_blocks();
+    bench_lanes();
+    bench_tree_walk();
+    bench_channels();
+    bench_spawn();
+    report_frame_sizes();
+    bench_idle_coroutines();
+    bench_scheduler();
+    bench_parallel_reduce();
+    bench_handoff();
+    bench_echo_server();
+    bench_file_read();
+    bench_records();
+    bench_timers();
+
+#if CPS_INSTRUMENTATION
+    bench_instrumentation();
+#endif
+#if CPS_TRACING
+    bench_tracing();
+#endif
+
+    bench_chains<int>();
+    bench_chains<float>();
+    bench_chains<double>();
+#if CPS_ARG_CAPACITY >= 32
+    bench_chains<bench::vec4>();
+#endif
+
+    if (bench::g_options.json)
+        bench::write_json(bench::g_options.json);
+
+    return 0;
+}
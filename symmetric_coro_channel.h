@@ -0,0 +1,249 @@
+#pragma once
+
+#include <assert.h>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Channels - a bounded buffer of `N` values between a sending and a
+// receiving coroutine, held in the channel object itself.
+//
+// A body sends by trying to put the value in the buffer, and suspends to
+// the channel when it cannot:
+//
+//   `send(ch, v)`   >>>
+//   ```
+//     if (!ch.try_send(v)) {
+//       return prepare_to_suspend(N, ch.send(v));
+//   case N:
+//       ;
+//     }
+//   ```
+//
+// and likewise receives, where the value lands in `v` and `received()`
+// tells whether there was one, or the channel was closed and empty:
+//
+//   `if (!receive(ch, v)) break;`   >>>
+//   ```
+//     if (!ch.try_receive(v)) {
+//       return prepare_to_suspend(N, ch.receive(v));
+//   case N:
+//       if (!ch.received())
+//         break;
+//     }
+//   ```
+//
+// As with the reactor, the continuations are re-armed on every call and
+// need no `process_resume`; a body closes the channel by suspending to
+// `ch.close()` the same way.
+//
+// A receiver that finds the channel empty waits in it. A sender that
+// finds it waiting hands the value straight to it and hops to it, and is
+// resumed in turn the next time the receiver waits. A sender that finds
+// the buffer full waits until the receiver has made room, and the run of
+// the trampoline ends there, so the buffer holds back a sender that gets
+// ahead. With `N` = 0 every value is handed over this way. No hop goes
+// through a queue, and nothing is allocated per value.
+//
+// A waiting sender is resumed only through the receiver's next wait, so a
+// receiver that stops before the channel is closed leaves it suspended,
+// as a consumer that stops early leaves a generator. Closing never waits:
+// the closer goes on, and a receiver waiting in the channel is resumed
+// once the thread's run loop drains (see `cps_run_loop`).
+//
+// One coroutine may wait to send and one to receive at a time. Values
+// must be default constructible and movable.
+
+template<class T, size_t N> class channel {
+  using cps_call_data = cps_target::cps_call_data;
+
+public:
+  constexpr static size_t capacity = N;
+
+  channel() = default;
+
+  channel(const channel&) = delete;
+  channel& operator=(const channel&) = delete;
+
+  // Buffers `value` if there is room and no receiver is waiting for it.
+  template<class U>
+  bool try_send(U&& value) {
+    assert(!_closed && "Sent on a closed channel");
+    if (_receiver || _size == N)
+      return false;
+    push(std::forward<U>(value));
+    return true;
+  }
+
+  // Takes the next value into `out`, if there is one.
+  bool try_receive(T& out) {
+    if (_size != 0) {
+      out = pop();
+      // A blocked sender's value takes the room it has made.
+      if (_blocked) {
+        push(std::move(_staged));
+        _blocked = false;
+      }
+    } else if (_blocked) {
+      out = std::move(_staged);
+      _blocked = false;
+    } else {
+      return false;
+    }
+    _received = true;
+    return true;
+  }
+
+  // The continuations a body suspends to in order to send, receive or
+  // close; see above.
+  template<class U>
+  resume_continuation<void()>& send(U&& value) {
+    assert(!_closed && "Sent on a closed channel");
+    _staged = std::forward<U>(value);
+    return arm(&_send_target);
+  }
+
+  resume_continuation<void()>& receive(T& out) {
+    _out = &out;
+    return arm(&_receive_target);
+  }
+
+  resume_continuation<void()>& close() {
+    assert(!_closed && "Closed a channel twice");
+    _closed = true;
+    return arm(&_send_target);
+  }
+
+  // Whether the last receive got a value.
+  bool received() const {
+    return _received;
+  }
+
+  bool closed() const {
+    return _closed;
+  }
+
+  // Values in the buffer.
+  size_t size() const {
+    return _size;
+  }
+
+private:
+  // Runs the channel's side of a send, or of a receive, for whatever
+  // suspends to it.
+  class send_target : public cps_target {
+  public:
+    explicit send_target(channel& ch) : _channel(ch) {}
+
+    cps_call_data __body(cps_call_data call_data) override {
+      return _channel.sent(call_data.cont);
+    }
+
+  private:
+    channel& _channel;
+  };
+
+  class receive_target : public cps_target {
+  public:
+    explicit receive_target(channel& ch) : _channel(ch) {}
+
+    cps_call_data __body(cps_call_data call_data) override {
+      return _channel.receiving(call_data.cont);
+    }
+
+  private:
+    channel& _channel;
+  };
+
+  static resume_continuation<void()>& arm(cps_target* target) {
+    thread_local resume_continuation<void()> cont;
+    cont = resume_continuation<void()>(target);
+    return cont;
+  }
+
+  // A staged value, or a close when `_closed` is set.
+  cps_call_data sent(cps_target* sender) {
+    assert(!_sender && "Two coroutines sending on the same channel");
+    if (_closed) {
+      // The receiver, if it waits, finds the channel empty and closed.
+      if (_receiver) {
+        _received = false;
+        _wake = resume_continuation<void()>(exchange(_receiver, nullptr));
+        cps_run_loop::post(_wake);
+      }
+      return {{}, sender};
+    }
+
+    if (_receiver) {
+      // The buffer is empty, since the receiver waits.
+      _received = true;
+      *_out = std::move(_staged);
+      _sender = sender;
+      return {{}, exchange(_receiver, nullptr)};
+    }
+
+    if (_size != N) {
+      push(std::move(_staged));
+      return {{}, sender};
+    }
+
+    _sender = sender;
+    _blocked = true;
+    return {{}, nullptr};
+  }
+
+  cps_call_data receiving(cps_target* receiver) {
+    assert(!_receiver && "Two coroutines receiving on the same channel");
+    if (try_receive(*_out))
+      return {{}, receiver};
+    if (_closed) {
+      _received = false;
+      return {{}, receiver};
+    }
+
+    // Wait, and let a sender that has handed over its value go on.
+    _receiver = receiver;
+    return {{}, exchange(_sender, nullptr)};
+  }
+
+  template<class U>
+  void push(U&& value) {
+    size_t tail = _head + _size;
+    _buffer[tail < N ? tail : tail - N] = std::forward<U>(value);
+    ++_size;
+  }
+
+  T pop() {
+    T value = std::move(_buffer[_head]);
+    _head = _head + 1 == N ? 0 : _head + 1;
+    --_size;
+    return value;
+  }
+
+  T _buffer[N ? N : 1];
+  size_t _head = 0;
+  size_t _size = 0;
+
+  // The sender's value while it waits for room.
+  T _staged{};
+  T* _out = nullptr;
+
+  // A suspended sender: blocked on a full buffer, or done with its send
+  // and waiting for its turn.
+  cps_target* _sender = nullptr;
+  bool _blocked = false;
+  cps_target* _receiver = nullptr;
+  bool _received = false;
+  bool _closed = false;
+  // Posts the receiver that waits when the channel is closed.
+  resume_continuation<void()> _wake;
+
+  send_target _send_target{*this};
+  receive_target _receive_target{*this};
+};
+
+};
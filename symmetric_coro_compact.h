@@ -0,0 +1,267 @@
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Compact coroutines - for very many small coroutines, where the vtable
+// pointer and the two 8-byte continuations of a `coroutine<>` outweigh
+// the state itself.
+//
+// A compact coroutine lives in the frame table of the thread that
+// created it and is named by a 32-bit handle: 8 bits of type, 24 bits of
+// index in that type's frame array. Its header is the handle of its
+// caller and its suspend point, 8 bytes in all, and it has no vtable:
+// the trampoline finds the body through the type bits. A `compact_range`
+// takes 20 bytes, so three frames share a cache line.
+//
+// Bodies are written as for `coroutine<>`, with handles as
+// continuations:
+//
+//   `val = r()`, where `r` is a `compact_handle` member   >>>
+//   ```
+//     return prepare_to_suspend(N, r);
+//   case N:
+//     val = process_resume<int>(r, call_data);
+//   ```
+//
+// and `yield(val)` suspends to `get_caller()`. A coroutine's own handle
+// is its continuation whenever it is suspended, so nothing is released
+// and re-armed around hops.
+//
+// Handles are only meaningful in the table that made them, and a table
+// must only be used from its own thread.
+
+using compact_handle = uint32_t;
+
+// Packs a continuation handle and type-erased data; 16 bytes, returned
+// in two registers.
+struct compact_call_data {
+  cps_target::cps_arg data;
+  compact_handle cont;
+};
+
+class compact_frame_table;
+
+template<class Derived> class compact_coroutine {
+public:
+  bool done() const {
+    return _sp == _sp_done;
+  }
+
+protected:
+  using cps_arg = cps_target::cps_arg;
+  using cps_call_data = compact_call_data;
+  using suspend_point = int;
+
+  suspend_point get_suspend_point() const {
+    return _sp;
+  }
+
+  compact_handle& get_caller() {
+    return _caller;
+  }
+
+  cps_call_data prepare_to_suspend(suspend_point sp, compact_handle cont) {
+    _sp = sp;
+    return {{}, cont};
+  }
+
+  template<typename ValType>
+  cps_call_data prepare_to_suspend(suspend_point sp, compact_handle cont, ValType&& val) {
+    static_assert(!cps_wire<remove_cvref_t<ValType>>::by_address,
+                  "Compact coroutines only pass values that travel inline");
+    _sp = sp;
+    return {{val}, cont};
+  }
+
+  void process_resume(compact_handle& cont, cps_call_data& call_data) {
+    cont = call_data.cont;
+  }
+
+  template<typename ValType>
+  ValType process_resume(compact_handle& cont, cps_call_data& call_data) {
+    cont = call_data.cont;
+    return call_data.data;
+  }
+
+  constexpr static suspend_point _sp_done = -1;
+
+private:
+  compact_handle _caller = 0;
+  suspend_point _sp = 0;
+};
+
+class compact_frame_table {
+public:
+  constexpr static unsigned index_bits = 24;
+  constexpr static uint32_t max_frames_per_type = uint32_t(1) << index_bits;
+  constexpr static unsigned max_types = 255;
+
+  compact_frame_table() = default;
+  compact_frame_table(const compact_frame_table&) = delete;
+  compact_frame_table& operator=(const compact_frame_table&) = delete;
+
+  ~compact_frame_table() {
+    for (type_pool& pool : _pools) {
+      if (pool.base) {
+        pool.destroy_all(pool);
+        munmap(pool.base, pool.reserved);
+      }
+    }
+  }
+
+  // The calling thread's table.
+  static compact_frame_table& current() {
+    thread_local compact_frame_table table;
+    return table;
+  }
+
+  template<class C, class... A>
+  compact_handle create(A&&... args) {
+    static_assert(is_base_of_v<compact_coroutine<C>, C>, "Compact coroutines derive from compact_coroutine<C>");
+    const unsigned type = type_id<C>();
+    type_pool& pool = pool_for<C>(type);
+
+    uint32_t index;
+    if (!pool.free.empty()) {
+      index = pool.free.back();
+      pool.free.pop_back();
+    } else {
+      assert(pool.high_water < max_frames_per_type && "Frame table full");
+      index = pool.high_water++;
+    }
+    new (pool.frame(index)) C(std::forward<A>(args)...);
+    ++pool.live;
+    return (compact_handle(type + 1) << index_bits) | index;
+  }
+
+  void destroy(compact_handle h) {
+    type_pool& pool = pool_of(h);
+    const uint32_t index = h & index_mask;
+    pool.destroy_one(pool.frame(index));
+    pool.free.push_back(index);
+    --pool.live;
+  }
+
+  template<class C> C& get(compact_handle h) {
+    assert((h >> index_bits) == type_id<C>() + 1 && "Handle of another type");
+    return *launder(static_cast<C*>(pool_of(h).frame(h & index_mask)));
+  }
+
+  // Runs `target` and whatever it hops to, until a body suspends to
+  // handle 0, the caller of the trampoline. Same as
+  // `cps_target::trampoline`, with the body found through the handle.
+  cps_target::cps_arg resume(compact_handle target, cps_target::cps_arg arg = {}) {
+    assert(target != 0);
+    compact_handle callee = target;
+    cps_target::cps_arg data = arg;
+    compact_handle cont = 0;
+
+    do {
+      type_pool& pool = pool_of(callee);
+      compact_call_data call_data = pool.body(pool.frame(callee & index_mask), {data, cont});
+
+      cont = callee;
+      callee = call_data.cont;
+      data = call_data.data;
+    } while (callee != 0);
+
+    return data;
+  }
+
+  // Live frames, and the memory their arrays have touched so far.
+  size_t size() const {
+    size_t n = 0;
+    for (const type_pool& pool : _pools)
+      n += pool.live;
+    return n;
+  }
+
+  size_t bytes_used() const {
+    size_t n = 0;
+    for (const type_pool& pool : _pools)
+      n += size_t(pool.high_water) * pool.frame_size;
+    return n;
+  }
+
+private:
+  constexpr static uint32_t index_mask = max_frames_per_type - 1;
+
+  // The frames of one type, in a single array reserved up front so that
+  // they never move; pages are only committed when first touched.
+  struct type_pool {
+    char* base = nullptr;
+    size_t reserved = 0;
+    size_t frame_size = 0;
+    compact_call_data (*body)(void* frame, compact_call_data call_data) = nullptr;
+    void (*destroy_one)(void* frame) = nullptr;
+    void (*destroy_all)(type_pool& pool) = nullptr;
+    uint32_t high_water = 0;
+    vector<uint32_t> free;
+    size_t live = 0;
+
+    void* frame(uint32_t index) {
+      return base + size_t(index) * frame_size;
+    }
+  };
+
+  // Ids are shared by all tables, so a type has the same one everywhere.
+  template<class C> static unsigned type_id() {
+    static const unsigned id = _next_type_id.fetch_add(1, memory_order_relaxed);
+    assert(id < max_types && "Too many compact coroutine types");
+    return id;
+  }
+
+  type_pool& pool_of(compact_handle h) {
+    assert((h >> index_bits) != 0 && "Invalid compact handle");
+    return _pools[(h >> index_bits) - 1];
+  }
+
+  template<class C> type_pool& pool_for(unsigned type) {
+    type_pool& pool = _pools[type];
+    if (pool.base)
+      return pool;
+
+    static_assert(alignof(C) <= 4096, "Frames are laid out from a page boundary");
+    pool.frame_size = sizeof(C);
+    pool.reserved = size_t(max_frames_per_type) * sizeof(C);
+    void* base = mmap(nullptr, pool.reserved, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+      throw bad_alloc();
+    pool.base = static_cast<char*>(base);
+
+    pool.body = [](void* frame, compact_call_data call_data) {
+      return launder(static_cast<C*>(frame))->__body(call_data);
+    };
+    pool.destroy_one = [](void* frame) {
+      launder(static_cast<C*>(frame))->~C();
+    };
+    pool.destroy_all = [](type_pool& pool) {
+      vector<bool> freed(pool.high_water);
+      for (uint32_t i : pool.free)
+        freed[i] = true;
+      for (uint32_t i = 0; i < pool.high_water; ++i)
+        if (!freed[i])
+          launder(static_cast<C*>(pool.frame(i)))->~C();
+    };
+    return pool;
+  }
+
+  type_pool _pools[max_types];
+
+  static inline atomic<unsigned> _next_type_id{0};
+};
+
+};
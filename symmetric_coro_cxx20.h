@@ -0,0 +1,200 @@
+#pragma once
+
+#include <assert.h>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// C++20 interop - generators written as C++20 coroutines that take
+// part in CPS chains as ordinary targets.
+//
+// The promise of a `cxx20_generator<T>` is a `coroutine<T()>`: its body
+// resumes the C++20 coroutine and returns the hop that the coroutine set
+// up before suspending, so CPS consumers drive it like any other
+// generator and it hops to CPS producers like any other consumer:
+//
+//   cxx20_generator<int> doubled(coroutine<int()>& src) {
+//     for (;;) {
+//       int v = co_await src;          // a hop to `src`, back with its value
+//       if (src.done())
+//         co_return 2 * v;             // the last value, as for `range`
+//       co_yield 2 * v;                // a hop to the caller
+//     }
+//   }
+//
+//   cxx20_generator<int> d = doubled(r);
+//   int v = d();                       // from plain code, or
+//   pipeline_multiply<coroutine<int()>, coroutine<int()>> m(d.cps(), r2);
+//
+// Every crossing between the two models is a hop of the trampoline
+// that is running the chain, and the C++20 coroutine always suspends
+// back to the body that resumed it before the next hop, so chains that
+// alternate between them run at constant stack depth. Awaiting another
+// `cxx20_generator` is such a hop too. No frame is allocated per
+// crossing; the C++20 frame itself is allocated once, when the
+// generator is created.
+//
+// A `cxx20_generator` can only await CPS coroutines and other
+// `cxx20_generator`s, and only be awaited by one.
+
+template<class T> class cxx20_generator;
+
+// `co_await coro` inside a `cxx20_generator`: hops to `coro` and evaluates
+// to the value it yields.
+template<class R> class cps_awaiter {
+public:
+  explicit cps_awaiter(coroutine<R()>& coro)
+    : _coro(coro)
+  {}
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  template<class P>
+  void await_suspend(coroutine_handle<P> h) {
+    static_assert(is_base_of_v<cps_target, P>, "CPS coroutines can only be awaited from a cxx20_generator");
+    _received = &h.promise().await_cps(_coro.get_cont());
+  }
+
+  R await_resume() {
+    if constexpr (!is_void_v<R>) {
+      R value = *_received;
+      return value;
+    }
+  }
+
+private:
+  coroutine<R()>& _coro;
+  const cps_target::cps_arg* _received = nullptr;
+};
+
+template<class R>
+cps_awaiter<R> operator co_await(coroutine<R()>& coro) {
+  return cps_awaiter<R>(coro);
+}
+
+template<class T> class cxx20_generator {
+public:
+  class promise_type : public coroutine<T()> {
+    using cps_arg = cps_target::cps_arg;
+    using cps_call_data = cps_target::cps_call_data;
+
+  public:
+    cxx20_generator get_return_object() {
+      return cxx20_generator(coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    suspend_always initial_suspend() noexcept {
+      return {};
+    }
+
+    suspend_always final_suspend() noexcept {
+      return {};
+    }
+
+    void unhandled_exception() {
+      terminate();
+    }
+
+    // `co_yield v` hops to the caller with `v`, kept in the promise until
+    // the caller has taken it.
+    template<class U>
+    suspend_always yield_value(U&& value) {
+      _yielded.emplace(std::forward<U>(value));
+      _next = this->prepare_to_suspend(1, this->get_caller(), *_yielded);
+      return {};
+    }
+
+    // `co_return v` hops to the caller with its last value.
+    template<class U>
+    void return_value(U&& value) {
+      _yielded.emplace(std::forward<U>(value));
+      _next = this->prepare_to_suspend(coroutine<>::_sp_done, this->get_caller(), *_yielded);
+    }
+
+    // Called by `cps_awaiter::await_suspend`. Returns where the value the
+    // awaited coroutine hops back with will be; values passed by address
+    // are moved out of it on resume, while their sender is still
+    // suspended.
+    const cps_arg& await_cps(resume_continuation<>& cont) {
+      _awaited = &cont;
+      _next = this->prepare_to_suspend(2, cont);
+      return _received;
+    }
+
+  private:
+    friend class cxx20_generator;
+
+    cps_call_data __body(cps_call_data call_data) override {
+      assert(!this->done() && "Called a completed coroutine");
+      if (_awaited) {
+        // Back from an awaited coroutine; `cont` is now wherever it left off.
+        this->process_resume(*_awaited, call_data);
+        _received = call_data.data;
+        _awaited = nullptr;
+      } else {
+        this->process_resume(this->get_caller(), call_data);
+      }
+
+      coroutine_handle<promise_type>::from_promise(*this).resume();
+      return _next;
+    }
+
+    cps_call_data _next;
+    resume_continuation<>* _awaited = nullptr;
+    cps_arg _received;
+    optional<T> _yielded;
+  };
+
+  using handle = coroutine_handle<promise_type>;
+
+  cxx20_generator(cxx20_generator&& other) noexcept
+    : _handle(exchange(other._handle, nullptr))
+  {}
+
+  cxx20_generator& operator=(cxx20_generator&&) = delete;
+
+  ~cxx20_generator() {
+    if (_handle)
+      _handle.destroy();
+  }
+
+  // The CPS face of the generator, for consumers that take a
+  // `coroutine<T()>`.
+  coroutine<T()>& cps() {
+    return _handle.promise();
+  }
+
+  T operator()() {
+    return cps()();
+  }
+
+  auto& get_cont() {
+    return cps().get_cont();
+  }
+
+  bool done() const {
+    return _handle.promise().done();
+  }
+
+private:
+  explicit cxx20_generator(handle h)
+    : _handle(h)
+  {}
+
+  handle _handle;
+};
+
+template<class T>
+cps_awaiter<T> operator co_await(cxx20_generator<T>& gen) {
+  return cps_awaiter<T>(gen.cps());
+}
+
+};
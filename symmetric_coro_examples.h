@@ -0,0 +1,2258 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+
+#include "symmetric_coro.h"
+#include "symmetric_coro_channel.h"
+#include "symmetric_coro_compact.h"
+#include "symmetric_coro_cxx20.h"
+#include "symmetric_coro_file.h"
+#include "symmetric_coro_frame.h"
+#include "symmetric_coro_handoff.h"
+#include "symmetric_coro_lanes.h"
+#include "symmetric_coro_reactor.h"
+#include "symmetric_coro_scheduler.h"
+#include "symmetric_coro_split.h"
+#include "symmetric_coro_timer.h"
+#include "symmetric_coro_yield_from.h"
+
+extern "C" int printf(const char*, ...);
+
+using namespace std;
+
+/// Example one: a coroutine that yields once. Demonstrates the difference
+/// between yielding and returning.
+///
+/// Should be able to be called exactly twice.
+
+/*
+yield_once() : coroutine<void(void)>
+{
+  yield(); // get_caller()();
+  return;
+}
+*/
+
+// Translates to
+class yield_once : public coroutine<void(void)>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    yield_once()
+    {}
+
+private:
+    struct corotine_state {
+    };
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            // Initial suspend point - save caller
+            process_resume(get_caller(), call_data);
+
+            // yield() == get_caller()() == expansion of suspend_to(get_caller()())
+            return prepare_to_suspend(1, get_caller());
+
+        case 1: // suspend point 1
+            process_resume(get_caller(), call_data);
+
+            // return
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+};
+
+/// Example two: a coroutine that prints a sequence of numbers. The start value
+/// and the step are passed to the coroutine constructor. Demonstrates coroutine
+/// creation arguments.
+///
+/// Should be able to be called infinitely many times.
+
+/*
+print_counter(int start, int step) : coroutine<void(void)> {
+  for (int i = start; ; i += step) {
+    printf("%d\n, i);
+    yield();
+  }
+}
+*/
+
+// Translates to:
+class print_counter : public coroutine<void(void)>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    print_counter(int start, int step)
+        : start(start)
+        , step(step)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int i; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            // Initial suspend point - Save caller
+            process_resume(get_caller(), call_data);
+
+            new (&__state.i) int(start);
+            for (;; __state.i += step) {
+                printf("%d\n", __state.i);
+
+                return prepare_to_suspend(1, get_caller());
+        case 1: // suspend point
+                process_resume(get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    int start;
+    int step;
+};
+
+/*
+print_range(int start, int end) : coroutine<void()>
+{
+  int i = start;
+  for (; i < end - 1; ++i) {
+    printf("%d\n", i);
+    yield();
+  }
+  if (i < end) {
+    printf("%d\n", i);
+  }
+}
+*/
+
+// Translates to:
+class print_range : public coroutine<void(void)>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    print_range(int start, int end)
+        : start(start)
+        , end(end)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int i; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0: // initial suspend point
+            process_resume(get_caller(), call_data);
+            new (&__state.i) int(start);
+            for (; __state.i < end - 1; ++__state.i) {
+                printf("%d\n", __state.i);
+                return prepare_to_suspend(1, get_caller());
+        case 1: // suspend point 1
+                process_resume(get_caller(), call_data);
+            }
+
+            if (__state.i < end) {
+                printf("%d\n", __state.i);
+            }
+
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    int start;
+    int end;
+};
+
+/// Example three: a coroutine which returns a range of numbers. The start
+/// and end value are passed to the coroutine constructor. Demonstrates how
+/// the coroutine produces values.
+///
+/// Should be able to be called (start - end) times.
+
+/*
+range(int start, int end) : coroutine<int()>
+{
+  for (int i = start; i < end - 1; ++i) {
+    yield(i);
+  }
+
+  return end - 1;
+}
+*/
+
+// Translates to:
+class range : public coroutine<int(void)>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    range(int start, int end)
+        : start(start)
+        , end(end)
+    {}
+
+    // Splittable (see symmetric_coro_split.h): takes the values of `other`
+    // after its first `keep`.
+    range(range& other, cps_split_t, size_t keep)
+        : start(other.start + int(keep))
+        , end(other.end)
+    {
+        assert(other.get_suspend_point() == 0 && "Split a range that has started");
+        assert(keep > 0 && keep < other.size());
+        other.end = start;
+    }
+
+    // At least one: a range always yields `end - 1`.
+    size_t size() const {
+        return start < end ? size_t(int64_t(end) - start) : 1;
+    }
+
+private:
+    struct coroutine_state {
+        union { int i; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0: // initial suspend point
+            process_resume(get_caller(), call_data);
+
+            for (new (&__state.i) int(start);
+                 __state.i < end - 1;
+                 ++__state.i) {
+                return prepare_to_suspend(1, get_caller(), __state.i);
+        case 1: // suspend point 1
+                process_resume(get_caller(), call_data);
+            }
+
+            return prepare_to_suspend(_sp_done, get_caller(), end - 1);
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    int start;
+    int end;
+};
+
+/// Example four: a coroutine which returns the values passed to it. Demonstrates
+/// how a coroutine consumes values.
+///
+/// Should be able to be called infinitely many times.
+
+/*
+echo() : coroutine<int(int)>
+{
+  int val = get_initial_value();
+
+  for (;;) {
+    val = yield(val);
+  }
+}
+*/
+
+// Translates to:
+class echo : public coroutine<int(int)>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    echo()
+    {}
+
+private:
+    struct coroutine_state {
+        union { int val; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0: // initial suspend point - saves the caller and the initial value
+            set_initial_value(process_resume<int>(get_caller(), call_data));
+
+            new (&__state.val) int(get_initial_value());
+
+            for (;;) {
+                return prepare_to_suspend(1, get_caller(), __state.val);
+
+        case 1:
+                __state.val = process_resume<int>(get_caller(), call_data);
+            }
+
+        default:
+            assert(true && "Called a completed coroutine");
+            return {};
+        };
+    }
+};
+
+/// Example five: a coroutine which consumes values from two range coroutines
+/// (provided by the caller) and returns the products of the values. Demonstrates
+/// control flow between coroutines.
+
+/*
+multiply(range& r1, range& r2) : coroutine<int()>
+{
+  assert(!r1.done() && !r2.done());
+
+  for(;;) {
+    int result = yield(r1() * r2());
+
+    if (!r1.done() && !r2.done())
+      yield(result);
+    else
+      return result;
+  }
+}
+*/
+
+// Translates to:
+class multiply : public coroutine<int()> {
+    friend struct std::cps_dispatch_access;
+
+public:
+    multiply(range& r1, range& r2)
+        : r1(r1)
+        , r2(r2)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int _temp1; };
+        union { int _temp2; };
+        union { int result; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            assert(!r1.done() && !r2.done());
+
+            for (;;) {
+                // _temp1 = r1();
+                return prepare_to_suspend(1, r1.get_cont());
+        case 1:
+                new (&__state._temp1) int(process_resume<int>(r1.get_cont(), call_data));
+
+                // _temp2 = r2();
+                return prepare_to_suspend(2, r2.get_cont());
+        case 2:
+                new (&__state._temp2) int(process_resume<int>(r2.get_cont(), call_data));
+
+                // result = temp1 * temp2;
+                new (&__state.result) int(__state._temp1 * __state._temp2);
+
+                if (!r1.done() && !r2.done()) {
+                    // yield(result);
+                    return prepare_to_suspend(3, get_caller(), __state.result);
+        case 3:
+                    process_resume(get_caller(), call_data);
+                } else {
+                    // yield(result);
+                    return prepare_to_suspend(_sp_done, get_caller(), __state.result);
+                }
+            }
+
+        default:
+            assert(true && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    range& r1;
+    range& r2;
+};
+
+/// Example six: a coroutine with two parameters that returns the running dot
+/// product of the pairs passed to it. Demonstrates that several arguments
+/// travel inline in one hop and arrive in the body as a `tuple`.
+
+/*
+dot() : coroutine<int(int, int)>
+{
+  auto [a, b] = get_initial_value();
+  int sum = 0;
+
+  for (;;) {
+    sum += a * b;
+    tie(a, b) = yield(sum);
+  }
+}
+*/
+
+// Translates to:
+class dot : public coroutine<int(int, int)>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    dot()
+    {}
+
+private:
+    struct coroutine_state {
+        union { int a; };
+        union { int b; };
+        union { int sum; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0: // initial suspend point - saves the caller and the initial values
+            set_initial_value(process_resume<tuple<int, int>>(get_caller(), call_data));
+
+            new (&__state.a) int(get<0>(get_initial_value()));
+            new (&__state.b) int(get<1>(get_initial_value()));
+            new (&__state.sum) int(0);
+
+            for (;;) {
+                __state.sum += __state.a * __state.b;
+                return prepare_to_suspend(1, get_caller(), __state.sum);
+
+        case 1:
+                tie(__state.a, __state.b) = process_resume<tuple<int, int>>(get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+};
+
+/// Example seven: `echo` for values that are expensive to copy or cannot be
+/// copied at all, like `std::string` or `std::unique_ptr`. Demonstrates that
+/// values are moved through hops, and that a coroutine destroys the locals
+/// that are live at its current suspend point when it is destroyed.
+
+/*
+move_echo<T>() : coroutine<T(T)>
+{
+  T val = move(get_initial_value());
+
+  for (;;) {
+    val = yield(move(val));
+  }
+}
+*/
+
+// Translates to:
+template<class T>
+class move_echo : public coroutine<T(T)>
+{
+    friend struct std::cps_dispatch_access;
+
+    using typename coroutine<T(T)>::cps_call_data;
+
+public:
+    move_echo()
+    {}
+
+    ~move_echo()
+    {
+        // `val` is live at suspend point 1.
+        if (this->get_suspend_point() == 1)
+            __state.val.~T();
+    }
+
+private:
+    struct coroutine_state {
+        coroutine_state() {}
+        ~coroutine_state() {}
+
+        union { T val; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (this->get_suspend_point())
+        {
+        case 0: // initial suspend point - saves the caller and the initial value
+            this->set_initial_value(this->template process_resume<T>(this->get_caller(), call_data));
+
+            new (&__state.val) T(std::move(this->get_initial_value()));
+
+            for (;;) {
+                // The caller moves `val` out when it resumes.
+                return this->prepare_to_suspend(1, this->get_caller(), __state.val);
+
+        case 1:
+                __state.val = this->template process_resume<T>(this->get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+};
+
+/// Example eight: `multiply` again, translated with computed-goto dispatch.
+/// Demonstrates resuming the body with a single indirect jump through a table
+/// of label addresses instead of the `switch`.
+
+/*
+goto_multiply(range& r1, range& r2) : coroutine<int()>
+{
+  assert(!r1.done() && !r2.done());
+
+  for(;;) {
+    int result = yield(r1() * r2());
+
+    if (!r1.done() && !r2.done())
+      yield(result);
+    else
+      return result;
+  }
+}
+*/
+
+// Translates to:
+class goto_multiply : public coroutine<int()> {
+    friend struct std::cps_dispatch_access;
+
+public:
+    goto_multiply(range& r1, range& r2)
+        : r1(r1)
+        , r2(r2)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int _temp1; };
+        union { int _temp2; };
+        union { int result; };
+    } __state;
+
+    cps_call_data __body(cps_call_data call_data) override
+    {
+        static void* const resume_labels[] = { &&done, &&sp0, &&sp1, &&sp2, &&sp3 };
+        goto *resume_labels[get_resume_index()];
+
+    sp0:
+        process_resume(get_caller(), call_data);
+
+        assert(!r1.done() && !r2.done());
+
+        for (;;) {
+            // _temp1 = r1();
+            return prepare_to_suspend(1, r1.get_cont());
+    sp1:
+            new (&__state._temp1) int(process_resume<int>(r1.get_cont(), call_data));
+
+            // _temp2 = r2();
+            return prepare_to_suspend(2, r2.get_cont());
+    sp2:
+            new (&__state._temp2) int(process_resume<int>(r2.get_cont(), call_data));
+
+            // result = temp1 * temp2;
+            new (&__state.result) int(__state._temp1 * __state._temp2);
+
+            if (!r1.done() && !r2.done()) {
+                // yield(result);
+                return prepare_to_suspend(3, get_caller(), __state.result);
+    sp3:
+                process_resume(get_caller(), call_data);
+            } else {
+                // yield(result);
+                return prepare_to_suspend(_sp_done, get_caller(), __state.result);
+            }
+        }
+
+    done:
+        assert(false && "Called a completed coroutine");
+        return {};
+    }
+
+    range& r1;
+    range& r2;
+};
+
+/// Example nine: block versions of `range` and `multiply`. Each hop carries up
+/// to `block_size` values, so the cost of a switch is spread over a block and
+/// the arithmetic becomes a loop the compiler can vectorize.
+
+/*
+block_range(int start, int end) : block_coroutine<int, 64>
+{
+  for (int i = start; ; ) {
+    int n = max(0, min(block_size, end - i));
+    for (int k = 0; k < n; ++k)
+      get_buffer()[k] = i + k;
+    i += n;
+
+    if (i < end)
+      yield(n);
+    else
+      return n;
+  }
+}
+*/
+
+// Translates to:
+class block_range : public block_coroutine<int, 64>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    block_range(int start, int end)
+        : start(start)
+        , end(end)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int i; };
+        union { int n; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0: // initial suspend point
+            process_resume(get_caller(), call_data);
+
+            for (new (&__state.i) int(start); ; ) {
+                new (&__state.n) int(max(0, min(int(block_size), end - __state.i)));
+                for (int k = 0; k < __state.n; ++k)
+                    get_buffer()[k] = __state.i + k;
+                __state.i += __state.n;
+
+                if (__state.i < end) {
+                    // yield(n);
+                    return prepare_to_suspend(1, get_caller(), __state.n);
+        case 1: // suspend point 1
+                    process_resume(get_caller(), call_data);
+                } else {
+                    // return n;
+                    return prepare_to_suspend(_sp_done, get_caller(), __state.n);
+                }
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    int start;
+    int end;
+};
+
+/*
+block_multiply(block_range& r1, block_range& r2) : block_coroutine<int, 64>
+{
+  assert(!r1.done() && !r2.done());
+
+  for (;;) {
+    span<const int> b1 = r1.next_block();
+    span<const int> b2 = r2.next_block();
+
+    int n = min(b1.size(), b2.size());
+    for (int k = 0; k < n; ++k)
+      get_buffer()[k] = b1[k] * b2[k];
+
+    if (!r1.done() && !r2.done())
+      yield(n);
+    else
+      return n;
+  }
+}
+*/
+
+// Translates to:
+class block_multiply : public block_coroutine<int, 64>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    block_multiply(block_range& r1, block_range& r2)
+        : r1(r1)
+        , r2(r2)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int _temp1; };
+        union { int _temp2; };
+        union { int n; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            assert(!r1.done() && !r2.done());
+
+            for (;;) {
+                // _temp1 = r1();
+                return prepare_to_suspend(1, r1.get_cont());
+        case 1:
+                new (&__state._temp1) int(process_resume<int>(r1.get_cont(), call_data));
+
+                // _temp2 = r2();
+                return prepare_to_suspend(2, r2.get_cont());
+        case 2:
+                new (&__state._temp2) int(process_resume<int>(r2.get_cont(), call_data));
+
+                new (&__state.n) int(min(__state._temp1, __state._temp2));
+                {
+                    const int* b1 = r1.get_block(__state._temp1).data();
+                    const int* b2 = r2.get_block(__state._temp2).data();
+                    int* out = get_buffer().data();
+                    for (int k = 0; k < __state.n; ++k)
+                        out[k] = b1[k] * b2[k];
+                }
+
+                if (!r1.done() && !r2.done()) {
+                    // yield(n);
+                    return prepare_to_suspend(3, get_caller(), __state.n);
+        case 3:
+                    process_resume(get_caller(), call_data);
+                } else {
+                    // return n;
+                    return prepare_to_suspend(_sp_done, get_caller(), __state.n);
+                }
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    block_range& r1;
+    block_range& r2;
+};
+
+/// Example ten: a coroutine that runs on the work-stealing scheduler and
+/// lets the other coroutines run between its steps. Demonstrates suspending
+/// to the scheduler instead of to the caller.
+///
+/// Adds `0 + 1 + ... + (steps - 1)` to `total`, one term per step.
+
+/*
+scheduled_sum(int steps, atomic<long>& total) : coroutine<void()>
+{
+  for (int i = 0; i < steps; ++i) {
+    total.fetch_add(i, memory_order_relaxed);
+    yield_to_scheduler();
+  }
+}
+*/
+
+// Translates to:
+class scheduled_sum : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    scheduled_sum(int steps, atomic<long>& total)
+        : steps(steps)
+        , total(total)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int i; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (new (&__state.i) int(0);
+                 __state.i < steps;
+                 ++__state.i) {
+                total.fetch_add(__state.i, memory_order_relaxed);
+
+                // yield_to_scheduler();
+                return prepare_to_suspend(1, scheduler::yield_to_scheduler());
+        case 1:
+                ; // resumed by whichever worker dequeued us
+            }
+
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    int steps;
+    atomic<long>& total;
+};
+
+/// Example eleven: a coroutine that moves back and forth between two threads.
+/// Each thread resumes whatever arrives in its queue. Demonstrates handing a
+/// coroutine over to another thread: `visits_a` and `visits_b` are plain
+/// ints, written on both threads, and only the queues order them.
+///
+/// Makes `round_trips` round trips, then sets `finished`.
+
+/*
+shuttle(int round_trips, Queue& to_a, Queue& to_b, atomic<bool>& finished) : coroutine<void()>
+{
+  for (int i = 0; i < round_trips; ++i) {
+    ++visits_a;
+    park(to_b);
+    ++visits_b;
+    park(to_a);
+  }
+  finished.store(true, memory_order_release);
+}
+*/
+
+// Translates to:
+template<class Queue>
+class shuttle : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+    using typename coroutine<void()>::cps_call_data;
+
+public:
+    shuttle(int round_trips, Queue& to_a, Queue& to_b, atomic<bool>& finished)
+        : round_trips(round_trips)
+        , to_a(to_a)
+        , to_b(to_b)
+        , finished(finished)
+    {}
+
+    int visits_a = 0;
+    int visits_b = 0;
+
+private:
+    struct coroutine_state {
+        union { int i; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (this->get_suspend_point())
+        {
+        case 0:
+            this->process_resume(this->get_caller(), call_data);
+
+            for (new (&__state.i) int(0);
+                 __state.i < round_trips;
+                 ++__state.i) {
+                ++visits_a;
+
+                // park(to_b);
+                return this->prepare_to_suspend(1, to_b.park());
+        case 1:
+                ++visits_b;
+
+                // park(to_a);
+                return this->prepare_to_suspend(2, to_a.park());
+        case 2:
+                ;
+            }
+
+            finished.store(true, memory_order_release);
+            return this->prepare_to_suspend(this->_sp_done, this->get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    int round_trips;
+    Queue& to_a;
+    Queue& to_b;
+    atomic<bool>& finished;
+};
+
+/// Example twelve: both ends of an echo protocol on the reactor. The
+/// session echoes everything it reads until end of file; the client sends
+/// `requests` messages of `size` bytes and checks each echo. Demonstrates
+/// calling the `fd_reader` / `fd_writer` helpers, which wait on the reactor
+/// whenever the socket would block.
+///
+/// Both take ownership of their fd, which must have been added to the
+/// reactor.
+
+/*
+echo_session(reactor& r, int fd) : coroutine<void()>
+{
+  for (;;) {
+    ssize_t n = read(reader, buf, sizeof(buf));
+    if (n <= 0)
+      break;
+    if (write(writer, buf, n) < 0)
+      break;
+  }
+  r.remove(fd);
+  close(fd);
+}
+*/
+
+// Translates to:
+class echo_session : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    echo_session(reactor& r, int fd)
+        : r(r)
+        , fd(fd)
+        , reader(r, fd)
+        , writer(r, fd)
+    {}
+
+private:
+    struct coroutine_state {
+        union { ssize_t n; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (;;) {
+                // n = read(reader, buf, sizeof(buf));
+                reader.set_buffer(buf, sizeof(buf));
+                return prepare_to_suspend(1, reader.get_cont());
+        case 1:
+                new (&__state.n) ssize_t(process_resume<ssize_t>(reader.get_cont(), call_data));
+                if (__state.n <= 0)
+                    break;
+
+                // if (write(writer, buf, n) < 0)
+                writer.set_buffer(buf, __state.n);
+                return prepare_to_suspend(2, writer.get_cont());
+        case 2:
+                if (process_resume<ssize_t>(writer.get_cont(), call_data) < 0)
+                    break;
+            }
+
+            r.remove(fd);
+            close(fd);
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    reactor& r;
+    int fd;
+    fd_reader reader;
+    fd_writer writer;
+    char buf[4096];
+};
+
+/*
+echo_client(reactor& r, int fd, int requests, int size) : coroutine<void()>
+{
+  for (int i = 0; i < requests; ++i) {
+    memset(out, 'a' + i % 26, size);
+    if (write(writer, out, size) < 0)
+      break;
+
+    int received = 0;
+    while (received < size) {
+      ssize_t n = read(reader, in + received, size - received);
+      if (n <= 0)
+        break;
+      received += n;
+    }
+    if (received < size)
+      break;
+
+    if (memcmp(in, out, size) == 0)
+      ++completed;
+  }
+  r.remove(fd);
+  close(fd);
+}
+*/
+
+// Translates to:
+class echo_client : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    constexpr static int max_size = 256;
+
+    echo_client(reactor& r, int fd, int requests, int size)
+        : r(r)
+        , fd(fd)
+        , requests(requests)
+        , size(size)
+        , reader(r, fd)
+        , writer(r, fd)
+    {
+        assert(size <= max_size);
+    }
+
+    int completed = 0;
+
+private:
+    struct coroutine_state {
+        union { int i; };
+        union { int received; };
+        union { ssize_t n; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (new (&__state.i) int(0);
+                 __state.i < requests;
+                 ++__state.i) {
+                memset(out, 'a' + __state.i % 26, size);
+
+                // if (write(writer, out, size) < 0)
+                writer.set_buffer(out, size);
+                return prepare_to_suspend(1, writer.get_cont());
+        case 1:
+                if (process_resume<ssize_t>(writer.get_cont(), call_data) < 0)
+                    break;
+
+                for (new (&__state.received) int(0);
+                     __state.received < size;
+                     __state.received += __state.n) {
+                    // n = read(reader, in + received, size - received);
+                    reader.set_buffer(in + __state.received, size - __state.received);
+                    return prepare_to_suspend(2, reader.get_cont());
+        case 2:
+                    new (&__state.n) ssize_t(process_resume<ssize_t>(reader.get_cont(), call_data));
+                    if (__state.n <= 0)
+                        break;
+                }
+                if (__state.received < size)
+                    break;
+
+                if (memcmp(in, out, size) == 0)
+                    ++completed;
+            }
+
+            r.remove(fd);
+            close(fd);
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    reactor& r;
+    int fd;
+    int requests;
+    int size;
+    fd_reader reader;
+    fd_writer writer;
+    char out[max_size];
+    char in[max_size];
+};
+
+/// Example thirteen: a coroutine that consumes a `file_reader` on a reactor.
+/// The reader suspends to the reactor whenever its next block is still being
+/// read, and the reactor resumes it, and through it this coroutine, once
+/// the read completes.
+///
+/// Adds up every byte of the file into `sum` and the byte count into `size`.
+
+/*
+file_checksum(file_reader& reader) : coroutine<void()>
+{
+  while (!reader.done()) {
+    span<const char> block = next_chunk(reader);
+    for (char c : block)
+      sum += (unsigned char)c;
+    size += block.size();
+  }
+}
+*/
+
+// Translates to:
+class file_checksum : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    file_checksum(file_reader& reader)
+        : reader(reader)
+    {}
+
+    uint64_t sum = 0;
+    uint64_t size = 0;
+
+private:
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            while (!reader.done()) {
+                // block = next_chunk(reader);
+                return prepare_to_suspend(1, reader.get_cont());
+        case 1:
+                {
+                    span<const char> block = reader.get_chunk(process_resume<int>(reader.get_cont(), call_data));
+                    for (char c : block)
+                        sum += (unsigned char)c;
+                    size += block.size();
+                }
+            }
+
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    file_reader& reader;
+};
+
+/// Example fourteen: `multiply` with a packed frame. Demonstrates keeping
+/// locals in plain variables and saving only those live across a suspend
+/// point into the frame.
+///
+/// Of `_temp1`, `_temp2` and `result`, only `_temp1` is live across a
+/// suspend point (2), so the frame holds a single `int`.
+
+/*
+packed_multiply(range& r1, range& r2) : coroutine<int()>
+{
+  assert(!r1.done() && !r2.done());
+
+  for(;;) {
+    int result = yield(r1() * r2());
+
+    if (!r1.done() && !r2.done())
+      yield(result);
+    else
+      return result;
+  }
+}
+*/
+
+// Translates to:
+class packed_multiply : public coroutine<int()> {
+    friend struct std::cps_dispatch_access;
+
+public:
+    packed_multiply(range& r1, range& r2)
+        : r1(r1)
+        , r2(r2)
+    {}
+
+    using frame = cps_frame<
+        cps_frame_slot<int, 2>, // _temp1
+        cps_frame_slot<int>,    // _temp2
+        cps_frame_slot<int>     // result
+    >;
+
+private:
+    enum { temp1_slot, temp2_slot, result_slot };
+
+    frame __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        int _temp1, _temp2, result;
+
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            assert(!r1.done() && !r2.done());
+
+            for (;;) {
+                // _temp1 = r1();
+                return prepare_to_suspend(1, r1.get_cont());
+        case 1:
+                _temp1 = process_resume<int>(r1.get_cont(), call_data);
+
+                // _temp2 = r2();
+                __state.save<temp1_slot>(_temp1);
+                return prepare_to_suspend(2, r2.get_cont());
+        case 2:
+                _temp1 = __state.load<temp1_slot>();
+                _temp2 = process_resume<int>(r2.get_cont(), call_data);
+
+                // result = temp1 * temp2;
+                result = _temp1 * _temp2;
+
+                if (!r1.done() && !r2.done()) {
+                    // yield(result);
+                    return prepare_to_suspend(3, get_caller(), result);
+        case 3:
+                    process_resume(get_caller(), call_data);
+                } else {
+                    // yield(result);
+                    return prepare_to_suspend(_sp_done, get_caller(), result);
+                }
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    range& r1;
+    range& r2;
+};
+
+/// Example fifteen: `range` and `multiply` as compact coroutines, which
+/// live in a frame table and refer to each other by 32-bit handles.
+/// Demonstrates handles as continuations.
+
+/*
+compact_range(int start, int end) : compact_coroutine<int()>
+{
+  same as range
+}
+*/
+
+// Translates to:
+class compact_range : public compact_coroutine<compact_range>
+{
+    friend class std::compact_frame_table;
+
+public:
+    compact_range(int start, int end)
+        : start(start)
+        , end(end)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int i; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data)
+    {
+        switch (get_suspend_point())
+        {
+        case 0: // initial suspend point
+            process_resume(get_caller(), call_data);
+
+            for (new (&__state.i) int(start);
+                 __state.i < end - 1;
+                 ++__state.i) {
+                return prepare_to_suspend(1, get_caller(), __state.i);
+        case 1: // suspend point 1
+                process_resume(get_caller(), call_data);
+            }
+
+            return prepare_to_suspend(_sp_done, get_caller(), end - 1);
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    int start;
+    int end;
+};
+
+/*
+compact_multiply(compact_range r1, compact_range r2) : compact_coroutine<int()>
+{
+  same as multiply, with `r1` and `r2` handles
+}
+*/
+
+// Translates to:
+class compact_multiply : public compact_coroutine<compact_multiply> {
+    friend class std::compact_frame_table;
+
+public:
+    compact_multiply(compact_handle r1, compact_handle r2)
+        : r1(r1)
+        , r2(r2)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int _temp1; };
+        union { int _temp2; };
+        union { int result; };
+    } __state;
+
+    // Whether the range behind `r` has returned its last value.
+    static bool range_done(compact_handle r) {
+        return compact_frame_table::current().get<compact_range>(r).done();
+    }
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data)
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            assert(!range_done(r1) && !range_done(r2));
+
+            for (;;) {
+                // _temp1 = r1();
+                return prepare_to_suspend(1, r1);
+        case 1:
+                new (&__state._temp1) int(process_resume<int>(r1, call_data));
+
+                // _temp2 = r2();
+                return prepare_to_suspend(2, r2);
+        case 2:
+                new (&__state._temp2) int(process_resume<int>(r2, call_data));
+
+                // result = temp1 * temp2;
+                new (&__state.result) int(__state._temp1 * __state._temp2);
+
+                if (!range_done(r1) && !range_done(r2)) {
+                    // yield(result);
+                    return prepare_to_suspend(3, get_caller(), __state.result);
+        case 3:
+                    process_resume(get_caller(), call_data);
+                } else {
+                    // return result;
+                    return prepare_to_suspend(_sp_done, get_caller(), __state.result);
+                }
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    compact_handle r1;
+    compact_handle r2;
+};
+
+/// Example sixteen: `range` and `multiply` as lane coroutines, `Lanes`
+/// instances of each stepped together. Demonstrates a body that runs for a
+/// group of lanes at once and masks every update, and lanes that finish
+/// at different times.
+
+/*
+lane_range(int start, int end) : lane_coroutine<int()>
+{
+  same as range, per lane
+}
+*/
+
+// Translates to:
+template<size_t Lanes>
+class lane_range : public lane_coroutine<lane_range<Lanes>, Lanes>
+{
+    using base = lane_coroutine<lane_range<Lanes>, Lanes>;
+    using typename base::suspend_point;
+    friend base;
+
+public:
+    // All lanes start out as empty ranges; `init` sets their bounds before
+    // they are first stepped.
+    lane_range()
+    {
+        for (size_t c = 0; c < base::chunk_count; ++c)
+            start[c] = end[c] = lane_int{};
+    }
+
+    void init(size_t lane, int lane_start, int lane_end)
+    {
+        assert(!this->done(lane));
+        start[lane / lane_width][lane % lane_width] = lane_start;
+        end[lane / lane_width][lane % lane_width] = lane_end;
+    }
+
+private:
+    struct coroutine_state {
+        lane_int i[base::chunk_count];
+    } __state;
+
+    inline __attribute__((always_inline)) lane_int __lanes_body(size_t c, suspend_point sp, lane_mask group)
+    {
+        lane_int& i = __state.i[c];
+        lane_mask more;
+
+        switch (sp)
+        {
+        case 0: // initial suspend point
+            for (i = group ? start[c] : i;; i = group ? i + 1 : i) {
+                // Lanes where `i < end - 1` yield `i`, the others return
+                // `end - 1`.
+                more = i < end[c] - 1;
+                this->prepare_to_suspend(c, group, more ? 1 : base::_sp_done);
+                return more ? i : end[c] - 1;
+        case 1: // suspend point 1
+                ;
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return lane_int{};
+        };
+    }
+
+    lane_int start[base::chunk_count];
+    lane_int end[base::chunk_count];
+};
+
+/*
+lane_multiply(lane_range r1, lane_range r2) : lane_coroutine<int()>
+{
+  same as multiply, per lane
+}
+*/
+
+// Translates to:
+template<size_t Lanes>
+class lane_multiply : public lane_coroutine<lane_multiply<Lanes>, Lanes>
+{
+    using base = lane_coroutine<lane_multiply<Lanes>, Lanes>;
+    using typename base::suspend_point;
+    friend base;
+
+public:
+    lane_multiply(lane_range<Lanes>& r1, lane_range<Lanes>& r2)
+        : r1(r1)
+        , r2(r2)
+    {}
+
+private:
+    struct coroutine_state {
+        lane_int result[base::chunk_count];
+    } __state;
+
+    inline __attribute__((always_inline)) lane_int __lanes_body(size_t c, suspend_point sp, lane_mask group)
+    {
+        lane_int& result = __state.result[c];
+        lane_mask more;
+
+        switch (sp)
+        {
+        case 0:
+            for (;;) {
+                // result = r1() * r2(); the same lanes of both ranges.
+                result = group ? r1.step(c, group) * r2.step(c, group) : result;
+
+                // Lanes where both ranges have more yield, the others
+                // return.
+                more = ~r1.done_mask(c) & ~r2.done_mask(c);
+                this->prepare_to_suspend(c, group, more ? 3 : base::_sp_done);
+                return result;
+        case 3:
+                ;
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return lane_int{};
+        };
+    }
+
+    lane_range<Lanes>& r1;
+    lane_range<Lanes>& r2;
+};
+
+/// Example seventeen: `multiply` as a static pipeline, templated on the types
+/// of its producers. Demonstrates one source for both modes:
+/// `pipeline_multiply<range, range>` calls the ranges' bodies inline and
+/// runs without hops, `pipeline_multiply<coroutine<int()>, coroutine<int()>>`
+/// hops to whatever producers it is given.
+
+/*
+template<class R1, class R2>
+pipeline_multiply(R1& r1, R2& r2) : coroutine<int()>
+{
+  same as multiply
+}
+*/
+
+// Translates to:
+template<class R1, class R2>
+class pipeline_multiply : public coroutine<int()> {
+    friend struct std::cps_dispatch_access;
+
+public:
+    pipeline_multiply(R1& r1, R2& r2)
+        : r1(r1)
+        , r2(r2)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int _temp1; };
+        union { int _temp2; };
+        union { int result; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            assert(!r1.done() && !r2.done());
+
+            for (;;) {
+                // _temp1 = r1();
+                if constexpr (!cps_inlinable_v<R1>)
+                    return prepare_to_suspend(1, r1.get_cont());
+                else
+                    call_data = call_inline(r1, r1.get_cont());
+                [[fallthrough]];
+        case 1:
+                new (&__state._temp1) int(process_resume<int>(r1.get_cont(), call_data));
+
+                // _temp2 = r2();
+                if constexpr (!cps_inlinable_v<R2>)
+                    return prepare_to_suspend(2, r2.get_cont());
+                else
+                    call_data = call_inline(r2, r2.get_cont());
+                [[fallthrough]];
+        case 2:
+                new (&__state._temp2) int(process_resume<int>(r2.get_cont(), call_data));
+
+                // result = temp1 * temp2;
+                new (&__state.result) int(__state._temp1 * __state._temp2);
+
+                if (!r1.done() && !r2.done()) {
+                    // yield(result);
+                    return prepare_to_suspend(3, get_caller(), __state.result);
+        case 3:
+                    process_resume(get_caller(), call_data);
+                } else {
+                    // return result;
+                    return prepare_to_suspend(_sp_done, get_caller(), __state.result);
+                }
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    R1& r1;
+    R2& r2;
+};
+
+/// Example eighteen: long chains of coroutines in constant stack space.
+/// `chain_relay` passes each call down a linked chain of relays and the
+/// answer back up, one hop per link. `starter` starts the next one of a
+/// chain by posting it to the thread's run loop, rather than calling it,
+/// which would nest one trampoline per link.
+
+/*
+chain_relay(chain_relay* next) : coroutine<int()>
+{
+  for (;;) {
+    if (next)
+      yield((*next)() + 1);
+    else
+      yield(0);
+  }
+}
+*/
+
+// Translates to:
+class chain_relay : public coroutine<int()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    explicit chain_relay(chain_relay* next)
+        : next(next)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int value; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (;;) {
+                if (next) {
+                    // value = (*next)() + 1;
+                    return prepare_to_suspend(1, next->get_cont());
+        case 1:
+                    new (&__state.value) int(process_resume<int>(next->get_cont(), call_data) + 1);
+                } else {
+                    new (&__state.value) int(0);
+                }
+
+                // yield(value);
+                return prepare_to_suspend(2, get_caller(), __state.value);
+        case 2:
+                process_resume(get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    chain_relay* next;
+};
+
+/*
+starter(starter* next, int& started) : coroutine<void()>
+{
+  ++started;
+  if (next)
+    cps_run_loop::post(*next);
+}
+*/
+
+// Translates to:
+class starter : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    starter(starter* next, int& started)
+        : next(next)
+        , started(started)
+    {}
+
+private:
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            ++started;
+            if (next)
+                cps_run_loop::post(*next);
+
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    starter* next;
+    int& started;
+};
+
+/// Example nineteen: in-order walks of a binary tree, which yield the
+/// values of the nodes. `tree_walk` resumes the walks of the subtrees and
+/// yields their values on, so a value from depth d takes 2 * d hops to
+/// reach the consumer. `delegating_tree_walk` delegates to them with
+/// `yield_from`, so that their values reach the consumer in one hop.
+/// Demonstrates delegation.
+
+struct tree_node {
+    int value;
+    tree_node* left;
+    tree_node* right;
+};
+
+/*
+tree_walk(tree_node* node) : coroutine<int()>
+{
+  if (node->left) {
+    tree_walk left(node->left);
+    while (!left.done())
+      yield(left());
+  }
+
+  if (!node->right)
+    return node->value;
+  yield(node->value);
+
+  tree_walk right(node->right);
+  for (;;) {
+    int value = right();
+    if (right.done())
+      return value;
+    yield(value);
+  }
+}
+*/
+
+// Translates to:
+class tree_walk : public coroutine<int()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    explicit tree_walk(tree_node* node)
+        : node(node)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int value; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            if (node->left) {
+                child.reset(new tree_walk(node->left));
+                do {
+                    // yield(left());
+                    return prepare_to_suspend(1, child->get_cont());
+        case 1:
+                    new (&__state.value) int(process_resume<int>(child->get_cont(), call_data));
+                    return prepare_to_suspend(2, get_caller(), __state.value);
+        case 2:
+                    process_resume(get_caller(), call_data);
+                } while (!child->done());
+            }
+
+            if (!node->right)
+                return prepare_to_suspend(_sp_done, get_caller(), node->value);
+            return prepare_to_suspend(3, get_caller(), node->value);
+        case 3:
+            process_resume(get_caller(), call_data);
+
+            child.reset(new tree_walk(node->right));
+            for (;;) {
+                // value = right();
+                return prepare_to_suspend(4, child->get_cont());
+        case 4:
+                new (&__state.value) int(process_resume<int>(child->get_cont(), call_data));
+
+                if (child->done())
+                    return prepare_to_suspend(_sp_done, get_caller(), __state.value);
+                return prepare_to_suspend(5, get_caller(), __state.value);
+        case 5:
+                process_resume(get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    tree_node* node;
+    // The walk of the subtree being yielded, left then right.
+    unique_ptr<tree_walk> child;
+};
+
+/*
+delegating_tree_walk(tree_node* node) : delegating_coroutine<int>
+{
+  if (node->left)
+    yield(yield_from(delegating_tree_walk(node->left)));
+
+  if (!node->right)
+    return node->value;
+  yield(node->value);
+
+  return yield_from(delegating_tree_walk(node->right));
+}
+*/
+
+// Translates to:
+class delegating_tree_walk : public delegating_coroutine<int>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    explicit delegating_tree_walk(tree_node* node)
+        : node(node)
+    {}
+
+private:
+    struct coroutine_state {
+        union { int value; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_start(call_data);
+
+            if (node->left) {
+                // yield(yield_from(left));
+                child.reset(new delegating_tree_walk(node->left));
+                return prepare_to_yield_from(1, *child);
+        case 1:
+                new (&__state.value) int(process_yield_from(*child, call_data));
+                return prepare_to_suspend(2, get_caller(), __state.value);
+        case 2:
+                process_resume(get_caller(), call_data);
+            }
+
+            if (!node->right)
+                return prepare_to_return(node->value);
+            return prepare_to_suspend(3, get_caller(), node->value);
+        case 3:
+            process_resume(get_caller(), call_data);
+
+            // return yield_from(right);
+            child.reset(new delegating_tree_walk(node->right));
+            return prepare_to_yield_from(4, *child);
+        case 4:
+            new (&__state.value) int(process_yield_from(*child, call_data));
+            return prepare_to_return(__state.value);
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    tree_node* node;
+    unique_ptr<delegating_tree_walk> child;
+};
+
+/// Example twenty: `range`, `multiply` and a relay as C++20 coroutines
+/// that mix freely with the CPS ones. They need no translation: their
+/// promise turns `co_yield`, `co_return` and `co_await` into hops.
+
+inline cxx20_generator<int> cxx20_range(int start, int end)
+{
+    for (int i = start; i < end - 1; ++i)
+        co_yield i;
+    co_return end - 1;
+}
+
+inline cxx20_generator<int> cxx20_multiply(coroutine<int()>& r1, coroutine<int()>& r2)
+{
+    assert(!r1.done() && !r2.done());
+
+    for (;;) {
+        int result = co_await r1;
+        result *= co_await r2;
+
+        if (r1.done() || r2.done())
+            co_return result;
+        co_yield result;
+    }
+}
+
+// Yields what `src` yields, plus one.
+inline cxx20_generator<int> cxx20_relay(coroutine<int()>& src)
+{
+    for (;;) {
+        int value = co_await src + 1;
+        if (src.done())
+            co_return value;
+        co_yield value;
+    }
+}
+
+/// Example twenty-one: a heartbeat that beats `beats` times, `interval` apart,
+/// on a timing wheel. Demonstrates sleeping on a `timer` owned by the
+/// coroutine; the wheel resumes it once the interval has passed, or its
+/// owner may cancel the timer and resume it early.
+
+/*
+heartbeat(timer_wheel& w, timer_wheel::clock::duration interval, int beats) : coroutine<void()>
+{
+  while (count < beats) {
+    sleep_for(w, interval);
+    ++count;
+  }
+}
+*/
+
+// Translates to:
+class heartbeat : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    heartbeat(timer_wheel& w, timer_wheel::clock::duration interval, int beats)
+        : w(w)
+        , interval(interval)
+        , beats(beats)
+    {}
+
+    int count() const {
+        return _count;
+    }
+
+    timer& get_timer() {
+        return t;
+    }
+
+private:
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            while (_count < beats) {
+                // sleep_for(w, interval);
+                return prepare_to_suspend(1, w.sleep_for(t, interval));
+        case 1:
+                ++_count;
+            }
+
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    timer_wheel& w;
+    timer t;
+    timer_wheel::clock::duration interval;
+    int beats;
+    int _count = 0;
+};
+
+/// Example twenty-two: a producer and a consumer joined by a channel
+/// rather than by reference. `channel_range` sends the integers of
+/// [start, end) and closes the channel; `channel_sum` adds up whatever it
+/// receives until then. Either may be started first.
+
+/*
+channel_range(Channel& ch, int start, int end) : coroutine<void()>
+{
+  for (int i = start; i < end; ++i)
+    send(ch, i);
+  close(ch);
+}
+*/
+
+// Translates to:
+template<class Channel>
+class channel_range : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    channel_range(Channel& ch, int start, int end)
+        : ch(ch)
+        , i(start)
+        , end(end)
+    {}
+
+private:
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (; i < end; ++i) {
+                // send(ch, i);
+                if (!ch.try_send(i)) {
+                    return prepare_to_suspend(1, ch.send(i));
+        case 1:
+                    ;
+                }
+            }
+
+            // close(ch);
+            return prepare_to_suspend(2, ch.close());
+        case 2:
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    Channel& ch;
+    int i;
+    int end;
+};
+
+/*
+channel_sum(Channel& ch) : coroutine<void()>
+{
+  int value;
+  while (receive(ch, value))
+    total += value;
+}
+*/
+
+// Translates to:
+template<class Channel>
+class channel_sum : public coroutine<void()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    explicit channel_sum(Channel& ch)
+        : ch(ch)
+    {}
+
+    long long total() const {
+        return _total;
+    }
+
+private:
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (;;) {
+                // if (!receive(ch, value)) break;
+                if (!ch.try_receive(value)) {
+                    return prepare_to_suspend(1, ch.receive(value));
+        case 1:
+                    if (!ch.received())
+                        break;
+                }
+                _total += value;
+            }
+
+            return prepare_to_suspend(_sp_done, get_caller());
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    Channel& ch;
+    int value = 0;
+    long long _total = 0;
+};
+
+/// Example twenty-three: a parser chained on top of a `record_reader`,
+/// yielding every `sep`-separated field of every record. The fields are
+/// views into the records, and so into the mapped file: nothing is
+/// copied. Demonstrates a generator of `string_view`s, which hop by
+/// address and so are yielded from the coroutine state.
+
+/*
+field_splitter(coroutine<string_view()>& records, char sep) : coroutine<string_view()>
+{
+  for (;;) {
+    string_view record = records();
+    bool last = records.done();
+    for (size_t k; (k = record.find(sep)) != string_view::npos; record.remove_prefix(k + 1))
+      yield(record.substr(0, k));
+    if (last)
+      return record;
+    yield(record);
+  }
+}
+*/
+
+// Translates to:
+class field_splitter : public coroutine<string_view()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    field_splitter(coroutine<string_view()>& records, char sep)
+        : records(records)
+        , sep(sep)
+    {}
+
+private:
+    struct coroutine_state {
+        string_view record;
+        string_view field;
+        bool last;
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        size_t k;
+
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (;;) {
+                // record = records();
+                return prepare_to_suspend(1, records.get_cont());
+        case 1:
+                __state.record = process_resume<string_view>(records.get_cont(), call_data);
+                __state.last = records.done();
+
+                while ((k = __state.record.find(sep)) != string_view::npos) {
+                    __state.field = __state.record.substr(0, k);
+                    __state.record.remove_prefix(k + 1);
+                    return prepare_to_suspend(2, get_caller(), __state.field);
+        case 2:
+                    process_resume(get_caller(), call_data);
+                }
+
+                if (__state.last)
+                    return prepare_to_suspend(_sp_done, get_caller(), __state.record);
+
+                return prepare_to_suspend(3, get_caller(), __state.record);
+        case 3:
+                process_resume(get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    coroutine<string_view()>& records;
+    char sep;
+};
+
+/// Example twenty-four: `multiply` as a splittable zip. It owns its two
+/// ranges, so that splitting it splits both at the same place, and yields
+/// products until either runs out. `range` and `zip_multiply` can be
+/// consumed in parallel pieces with `parallel_for_each` and
+/// `parallel_reduce`.
+
+/*
+zip_multiply(int start1, int end1, int start2, int end2) : coroutine<long long()>
+{
+  range r1(start1, end1), r2(start2, end2);
+  for (;;) {
+    long long product = (long long)r1() * r2();
+    if (r1.done() || r2.done())
+      return product;
+    yield(product);
+  }
+}
+*/
+
+// Translates to:
+class zip_multiply : public coroutine<long long()>
+{
+    friend struct std::cps_dispatch_access;
+
+public:
+    zip_multiply(int start1, int end1, int start2, int end2)
+        : r1(start1, end1)
+        , r2(start2, end2)
+    {}
+
+    zip_multiply(zip_multiply& other, cps_split_t, size_t keep)
+        : r1(other.r1, cps_split, keep)
+        , r2(other.r2, cps_split, keep)
+    {
+        assert(other.get_suspend_point() == 0 && "Split a zip that has started");
+    }
+
+    size_t size() const {
+        return min(r1.size(), r2.size());
+    }
+
+private:
+    struct coroutine_state {
+        union { int a; };
+        union { long long product; };
+    } __state;
+
+    inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override
+    {
+        switch (get_suspend_point())
+        {
+        case 0:
+            process_resume(get_caller(), call_data);
+
+            for (;;) {
+                // product = (long long)r1() * r2();
+                return prepare_to_suspend(1, r1.get_cont());
+        case 1:
+                new (&__state.a) int(process_resume<int>(r1.get_cont(), call_data));
+                return prepare_to_suspend(2, r2.get_cont());
+        case 2:
+                new (&__state.product) long long((long long)__state.a * process_resume<int>(r2.get_cont(), call_data));
+
+                if (r1.done() || r2.done())
+                    return prepare_to_suspend(_sp_done, get_caller(), __state.product);
+
+                return prepare_to_suspend(3, get_caller(), __state.product);
+        case 3:
+                process_resume(get_caller(), call_data);
+            }
+
+        default:
+            assert(false && "Called a completed coroutine");
+            return {};
+        };
+    }
+
+    range r1;
+    range r2;
+};
@@ -0,0 +1,731 @@
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <endian.h>
+#include <linux/io_uring.h>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "symmetric_coro.h"
+#include "symmetric_coro_reactor.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Asynchronous file reads - a generator that keeps a number of
+// reads in flight and yields the file block by block, straight
+// from the buffers the kernel wrote into.
+
+// Minimal io_uring, driven through the raw system calls. Only what
+// `file_reader` needs: one submission per read and a completion
+// callback per reaped entry.
+class io_uring_queue {
+public:
+  // Returns nullptr when the kernel has no io_uring or forbids it.
+  static unique_ptr<io_uring_queue> create(unsigned entries) {
+    io_uring_params params = {};
+    int fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+      return nullptr;
+
+    unique_ptr<io_uring_queue> ring(new io_uring_queue(fd));
+    if (!ring->map(params))
+      return nullptr;
+    return ring;
+  }
+
+  io_uring_queue(const io_uring_queue&) = delete;
+  io_uring_queue& operator=(const io_uring_queue&) = delete;
+
+  ~io_uring_queue() {
+    if (_sqes != MAP_FAILED)
+      munmap(_sqes, _sqes_size);
+    if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring)
+      munmap(_cq_ring, _cq_ring_size);
+    if (_sq_ring != MAP_FAILED)
+      munmap(_sq_ring, _sq_ring_size);
+    close(_fd);
+  }
+
+  // Lets reads target `buffers` by index, without the kernel pinning the
+  // pages on each one.
+  bool register_buffers(const iovec* buffers, unsigned count) {
+    return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+  }
+
+  // Signals `event_fd` whenever a completion is posted.
+  bool register_eventfd(int event_fd) {
+    return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_EVENTFD, &event_fd, 1) == 0;
+  }
+
+  // Queues a read; `buffer_index` selects a registered buffer, or is -1.
+  // Returns false when the submission queue is full.
+  bool read(int fd, void* buf, unsigned len, uint64_t offset, int buffer_index, uint64_t user_data) {
+    unsigned tail = *_sq_tail;
+    if (tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _sq_entries)
+      return false;
+
+    unsigned index = tail & *_sq_mask;
+    io_uring_sqe& sqe = _sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = buffer_index >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.addr = uint64_t(uintptr_t(buf));
+    sqe.len = len;
+    sqe.off = offset;
+    sqe.buf_index = uint16_t(buffer_index >= 0 ? buffer_index : 0);
+    sqe.user_data = user_data;
+
+    _sq_array[index] = index;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++_unsubmitted;
+    return true;
+  }
+
+  // Hands the queued reads to the kernel, waiting for at least
+  // `min_complete` completions.
+  int submit(unsigned min_complete = 0) {
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    int n = int(syscall(__NR_io_uring_enter, _fd, _unsubmitted, min_complete, flags, nullptr, 0));
+    if (n < 0 && errno != EINTR)
+      throw system_error(errno, system_category(), "io_uring_enter");
+    if (n > 0)
+      _unsubmitted -= unsigned(n);
+    return n;
+  }
+
+  // Calls `f(user_data, result)` for every posted completion.
+  template<class F>
+  unsigned reap(F&& f) {
+    unsigned head = *_cq_head;
+    unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    unsigned count = tail - head;
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = _cqes[head & *_cq_mask];
+      f(cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+    return count;
+  }
+
+private:
+  explicit io_uring_queue(int fd) : _fd(fd) {}
+
+  bool map(const io_uring_params& p) {
+    _sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    _cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+      _sq_ring_size = _cq_ring_size = max(_sq_ring_size, _cq_ring_size);
+
+    _sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    _fd, IORING_OFF_SQ_RING);
+    if (_sq_ring == MAP_FAILED)
+      return false;
+    _cq_ring = single_mmap ? _sq_ring
+                           : mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+    if (_cq_ring == MAP_FAILED)
+      return false;
+
+    _sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    _sqes = static_cast<io_uring_sqe*>(mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+    if (_sqes == MAP_FAILED)
+      return false;
+
+    char* sq = static_cast<char*>(_sq_ring);
+    _sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    _sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    _sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    _sq_entries = p.sq_entries;
+
+    char* cq = static_cast<char*>(_cq_ring);
+    _cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    _cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+  }
+
+  int _fd;
+  void* _sq_ring = MAP_FAILED;
+  void* _cq_ring = MAP_FAILED;
+  io_uring_sqe* _sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+  size_t _sq_ring_size = 0;
+  size_t _cq_ring_size = 0;
+  size_t _sqes_size = 0;
+
+  unsigned* _sq_head = nullptr;
+  unsigned* _sq_tail = nullptr;
+  unsigned* _sq_mask = nullptr;
+  unsigned* _sq_array = nullptr;
+  unsigned _sq_entries = 0;
+  unsigned _unsubmitted = 0;
+
+  unsigned* _cq_head = nullptr;
+  unsigned* _cq_tail = nullptr;
+  unsigned* _cq_mask = nullptr;
+  io_uring_cqe* _cqes = nullptr;
+};
+
+// Fallback for kernels without io_uring: a few threads doing blocking
+// `pread`s. Each finished read stores its result, then signals an eventfd,
+// like io_uring does with a registered one.
+class pread_pool {
+public:
+  struct request {
+    int fd;
+    void* buf;
+    size_t len;
+    off_t offset;
+    atomic<ssize_t>* result;   // Written before `event_fd` is signalled.
+    int event_fd;
+  };
+
+  explicit pread_pool(unsigned threads) {
+    for (unsigned i = 0; i < threads; ++i)
+      _threads.emplace_back([this] { work(); });
+  }
+
+  pread_pool(const pread_pool&) = delete;
+  pread_pool& operator=(const pread_pool&) = delete;
+
+  // Finishes the reads already started; queued ones are dropped.
+  ~pread_pool() {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _stopping = true;
+      _requests.clear();
+    }
+    _wakeup.notify_all();
+    for (thread& t : _threads)
+      t.join();
+  }
+
+  void submit(const request& r) {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _requests.push_back(r);
+    }
+    _wakeup.notify_one();
+  }
+
+private:
+  void work() {
+    for (;;) {
+      request r;
+      {
+        unique_lock<mutex> lock(_mutex);
+        _wakeup.wait(lock, [this] { return _stopping || !_requests.empty(); });
+        if (_stopping)
+          return;
+        r = _requests.front();
+        _requests.pop_front();
+      }
+
+      ssize_t n;
+      do {
+        n = pread(r.fd, r.buf, r.len, r.offset);
+      } while (n < 0 && errno == EINTR);
+
+      r.result->store(n < 0 ? -errno : n, memory_order_release);
+      uint64_t one = 1;
+      ssize_t rc = ::write(r.event_fd, &one, sizeof(one));
+      (void)rc;
+    }
+  }
+
+  mutex _mutex;
+  condition_variable _wakeup;
+  std::deque<request> _requests;
+  bool _stopping = false;
+  vector<thread> _threads;
+};
+
+// Yields a file block by block, keeping `queue_depth` reads in flight
+// ahead of the consumer. Each resume returns the byte count of the next
+// block, or `-errno`; the last block is returned rather than yielded, so
+// `done()` turns true with it. The bytes are those the kernel read into the
+// reader's buffers, and stay valid until the reader is resumed again.
+//
+// Reads go through io_uring when available, and a `pread_pool` otherwise.
+// Without a reactor, waiting for a read blocks the calling thread. With
+// one, the reader suspends to `r.readable()` on its completion eventfd, so
+// it must then be resumed from a coroutine running on that reactor:
+//
+//   `n = next(reader)`   >>>
+//   ```
+//     return prepare_to_suspend(N, reader.get_cont());
+//   case N:
+//     n = process_resume<int>(reader.get_cont(), call_data);
+//     span<const char> block = reader.get_chunk(n);
+//   ```
+class file_reader : public coroutine<int()> {
+  friend struct cps_dispatch_access;
+
+public:
+  enum class backend { automatic, io_uring, thread_pool };
+
+  struct options {
+    size_t block_size = 128 * 1024;
+    unsigned queue_depth = 8;
+    backend use = backend::automatic;
+    unsigned pool_threads = 4;
+  };
+
+  // Reads `fd`, which stays owned by the caller, from offset 0 to its
+  // current size.
+  explicit file_reader(int fd, reactor* r = nullptr)
+    : file_reader(fd, options(), r)
+  {}
+
+  file_reader(int fd, const options& opts, reactor* r = nullptr)
+    : _fd(fd)
+    , _reactor(r)
+    , _block_size(opts.block_size)
+    , _depth(opts.queue_depth)
+    , _slots(opts.queue_depth)
+  {
+    assert(_depth > 0 && _block_size > 0 && _block_size <= size_t(INT32_MAX));
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+      throw system_error(errno, system_category(), "fstat");
+    _size = uint64_t(st.st_size);
+    _blocks = (_size + _block_size - 1) / _block_size;
+
+    _event_fd = eventfd(0, EFD_CLOEXEC);
+    if (_event_fd < 0)
+      throw system_error(errno, system_category(), "eventfd");
+
+    _buffers = static_cast<char*>(aligned_alloc(4096, _block_size * _depth));
+    if (!_buffers)
+      throw bad_alloc();
+    for (unsigned i = 0; i < _depth; ++i)
+      _slots[i].buf = _buffers + i * _block_size;
+
+    if (opts.use != backend::thread_pool)
+      _ring = io_uring_queue::create(_depth);
+    if (_ring) {
+      if (!_ring->register_eventfd(_event_fd))
+        _ring.reset();
+    }
+    if (_ring) {
+      vector<iovec> iovecs(_depth);
+      for (unsigned i = 0; i < _depth; ++i)
+        iovecs[i] = { _slots[i].buf, _block_size };
+      _fixed_buffers = _ring->register_buffers(iovecs.data(), _depth);
+    } else if (opts.use == backend::io_uring) {
+      throw system_error(ENOSYS, system_category(), "io_uring");
+    } else {
+      _pool.reset(new pread_pool(opts.pool_threads));
+    }
+
+    if (_reactor)
+      _reactor->add(_event_fd);
+  }
+
+  file_reader(const file_reader&) = delete;
+  file_reader& operator=(const file_reader&) = delete;
+
+  ~file_reader() {
+    // The kernel or the pool may still be writing into the buffers.
+    if (_ring) {
+      while (_in_flight) {
+        _ring->submit(1);
+        reap();
+      }
+    }
+    _pool.reset();
+
+    if (_reactor)
+      _reactor->remove(_event_fd);
+    close(_event_fd);
+    free(_buffers);
+  }
+
+  bool uses_io_uring() const {
+    return bool(_ring);
+  }
+
+  // Always inlined in non-coroutines.
+  span<const char> next_chunk() {
+    return get_chunk((*this)());
+  }
+
+  // The block produced by the resume that returned `count`; empty on
+  // errors.
+  span<const char> get_chunk(int count) const {
+    if (count <= 0)
+      return {};
+    return { _slots[_current % _depth].buf, size_t(count) };
+  }
+
+private:
+  struct slot {
+    char* buf = nullptr;
+    atomic<ssize_t> result{0};
+    // Whether no read into the slot is in flight.
+    bool complete = true;
+    // What the reads of its block have brought in so far.
+    size_t filled = 0;
+  };
+
+  // Sentinel stored in `slot::result` while a pool read is pending.
+  constexpr static ssize_t pending = INT64_MIN;
+
+  void submit(uint64_t block) {
+    _slots[block % _depth].filled = 0;
+    submit_rest(block);
+  }
+
+  // Reads what is still missing of `block` into its slot.
+  void submit_rest(uint64_t block) {
+    slot& s = _slots[block % _depth];
+    s.complete = false;
+    const uint64_t offset = block * _block_size + s.filled;
+    const size_t len = _block_size - s.filled;
+    const unsigned index = unsigned(block % _depth);
+
+    if (_ring) {
+      bool queued = _ring->read(_fd, s.buf + s.filled, unsigned(len), offset,
+                                _fixed_buffers ? int(index) : -1, index);
+      assert(queued && "More reads than ring entries");
+      (void)queued;
+      _ring->submit();
+    } else {
+      s.result.store(pending, memory_order_relaxed);
+      _pool->submit({ _fd, s.buf + s.filled, len, off_t(offset), &s.result, _event_fd });
+    }
+    ++_in_flight;
+  }
+
+  // The bytes of `block` within the size the file had when opened.
+  size_t block_length(uint64_t block) const {
+    return size_t(min<uint64_t>(_block_size, _size - block * _block_size));
+  }
+
+  // Whether `block` is read: in full, up to an error or up to an end of
+  // file. A short read before that reads the rest of the block.
+  bool block_ready(uint64_t block) {
+    slot& s = _slots[block % _depth];
+    if (!s.complete)
+      return false;
+    const ssize_t res = s.result.load(memory_order_relaxed);
+    if (res <= 0)
+      return true;
+    s.filled += size_t(res);
+    if (s.filled >= block_length(block))
+      return true;
+    submit_rest(block);
+    return false;
+  }
+
+  // The byte count of a ready block, or `-errno`.
+  int block_result(uint64_t block) const {
+    const slot& s = _slots[block % _depth];
+    const ssize_t res = s.result.load(memory_order_relaxed);
+    return res < 0 ? int(res) : int(s.filled);
+  }
+
+  // Marks the reads that finished since the last call.
+  void reap() {
+    if (_ring) {
+      _ring->reap([this](uint64_t index, int32_t res) {
+        slot& s = _slots[index];
+        s.result.store(res, memory_order_relaxed);
+        s.complete = true;
+        --_in_flight;
+      });
+    } else {
+      for (slot& s : _slots) {
+        if (!s.complete && s.result.load(memory_order_acquire) != pending) {
+          s.complete = true;
+          --_in_flight;
+        }
+      }
+    }
+  }
+
+  // Consumes the completion signals. False when there were none, i.e.
+  // the reader must wait before reaping again.
+  bool drain_event_fd() {
+    uint64_t count;
+    ssize_t n = ::read(_event_fd, &count, sizeof(count));
+    return n == sizeof(count) || (n < 0 && errno == EINTR);
+  }
+
+  inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override {
+    switch (get_suspend_point()) {
+    case 0:
+      process_resume(get_caller(), call_data);
+
+      if (_blocks == 0)
+        return prepare_to_suspend(_sp_done, get_caller(), 0);
+
+      for (uint64_t b = 0; b < _blocks && b < _depth; ++b)
+        submit(b);
+
+      // The last block returns from the loop.
+      for (_current = 0;; ++_current) {
+        for (;;) {
+          reap();
+          if (block_ready(_current))
+            break;
+          if (!drain_event_fd()) {
+            assert(_reactor && "Blocking eventfd read failed");
+            // Waits for the next completion on the reactor.
+            return prepare_to_suspend(1, _reactor->readable(_event_fd));
+    case 1:
+            ;
+          }
+        }
+
+        // A file that has shrunk since it was opened ends early.
+        _result = block_result(_current);
+        if (_result <= 0 || _current + 1 == _blocks || size_t(_result) < block_length(_current))
+          return prepare_to_suspend(_sp_done, get_caller(), _result);
+
+        return prepare_to_suspend(2, get_caller(), _result);
+    case 2:
+        process_resume(get_caller(), call_data);
+
+        // The consumer is done with the block; reuse its buffer.
+        if (_current + _depth < _blocks)
+          submit(_current + _depth);
+      }
+
+    default:
+      assert(false && "Called a completed coroutine");
+      return {};
+    }
+  }
+
+  int _fd;
+  reactor* _reactor;
+  size_t _block_size;
+  unsigned _depth;
+  uint64_t _size = 0;
+  uint64_t _blocks = 0;
+  uint64_t _current = 0;
+  unsigned _in_flight = 0;
+  int _result = 0;
+
+  int _event_fd = -1;
+  char* _buffers = nullptr;
+  vector<slot> _slots;
+  unique_ptr<io_uring_queue> _ring;
+  bool _fixed_buffers = false;
+  unique_ptr<pread_pool> _pool;
+};
+
+///////////////////////////////////////////////////////////
+// Memory-mapped records - a generator that yields the records of a
+// mapped file as `string_view`s into the mapping, so nothing is copied on
+// the way to the consumer, nor between the parsers chained on top.
+
+// A read-only mapping of a whole file, which may be closed afterwards.
+// The kernel is told accesses will be sequential, so it reads ahead
+// further and drops pages behind. With `hugepages` the mapping is aligned
+// to 2 MiB and the kernel asked to back it with transparent huge pages,
+// which not every file system supports; `hugepages()` tells whether it
+// agreed.
+class mapped_file {
+public:
+  constexpr static size_t huge_page_size = 2 << 20;
+
+  struct options {
+    bool sequential = true;
+    bool hugepages = false;
+    bool populate = false;
+  };
+
+  explicit mapped_file(int fd)
+    : mapped_file(fd, options())
+  {}
+
+  mapped_file(int fd, const options& opts) {
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+      throw system_error(errno, system_category(), "fstat");
+    _size = size_t(st.st_size);
+    if (_size == 0)
+      return;
+
+    const int flags = MAP_PRIVATE | (opts.populate ? MAP_POPULATE : 0);
+    void* addr = opts.hugepages ? map_aligned(fd, flags) : mmap(nullptr, _size, PROT_READ, flags, fd, 0);
+    if (addr == MAP_FAILED)
+      throw system_error(errno, system_category(), "mmap");
+    _data = static_cast<const char*>(addr);
+
+    // Both are hints; a kernel that does not take them still maps the file.
+    if (opts.sequential)
+      madvise(addr, _size, MADV_SEQUENTIAL);
+    if (opts.hugepages)
+      _hugepages = madvise(addr, _size, MADV_HUGEPAGE) == 0;
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  ~mapped_file() {
+    if (_data)
+      munmap(const_cast<char*>(_data), _size);
+  }
+
+  const char* data() const {
+    return _data;
+  }
+
+  size_t size() const {
+    return _size;
+  }
+
+  string_view view() const {
+    return { _data, _size };
+  }
+
+  bool hugepages() const {
+    return _hugepages;
+  }
+
+private:
+  // Maps the file at a huge page boundary, inside a reservation trimmed
+  // to it afterwards.
+  void* map_aligned(int fd, int flags) {
+    const size_t page = size_t(sysconf(_SC_PAGESIZE));
+    const size_t reserved = _size + huge_page_size;
+    void* reservation = mmap(nullptr, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED)
+      return MAP_FAILED;
+
+    char* begin = static_cast<char*>(reservation);
+    char* aligned = reinterpret_cast<char*>((uintptr_t(begin) + huge_page_size - 1) & ~(huge_page_size - 1));
+    void* addr = mmap(aligned, _size, PROT_READ, flags | MAP_FIXED, fd, 0);
+    if (addr == MAP_FAILED) {
+      int error = errno;
+      munmap(reservation, reserved);
+      errno = error;
+      return MAP_FAILED;
+    }
+
+    char* mapped_end = aligned + (_size + page - 1) / page * page;
+    if (aligned != begin)
+      munmap(begin, size_t(aligned - begin));
+    if (mapped_end < begin + reserved)
+      munmap(mapped_end, size_t(begin + reserved - mapped_end));
+    return addr;
+  }
+
+  const char* _data = nullptr;
+  size_t _size = 0;
+  bool _hugepages = false;
+};
+
+// Yields the records of `data`, usually a `mapped_file`, in the style of
+// `range`: each resume returns the next one, and the last is returned
+// rather than yielded, so `done()` turns true with it. Records are lines,
+// without their '\n', or records prefixed by their length as a 32-bit
+// little-endian integer. The views point into `data`.
+//
+// Views travel by address (see `cps_wire`): a consumer must take the
+// value before the reader is resumed again. A record that runs past the
+// end ends the reader with an empty view, and `truncated()` turns true.
+class record_reader : public coroutine<string_view()> {
+  friend struct cps_dispatch_access;
+
+public:
+  enum class format { lines, length_prefixed };
+
+  explicit record_reader(string_view data, format f = format::lines)
+    : _pos(data.data())
+    , _end(data.data() + data.size())
+    , _format(f)
+  {}
+
+  explicit record_reader(const mapped_file& file, format f = format::lines)
+    : record_reader(file.view(), f)
+  {}
+
+  bool truncated() const {
+    return _truncated;
+  }
+
+private:
+  // Takes the next record; false once there is none left.
+  bool next_record() {
+    if (_format == format::lines) {
+      if (_pos == _end) {
+        _record = {};
+        return false;
+      }
+      const char* newline = static_cast<const char*>(memchr(_pos, '\n', size_t(_end - _pos)));
+      const char* stop = newline ? newline : _end;
+      _record = string_view(_pos, size_t(stop - _pos));
+      _pos = newline ? newline + 1 : _end;
+      return _pos != _end;
+    }
+
+    const size_t left = size_t(_end - _pos);
+    uint32_t length = 0;
+    if (left >= sizeof(length)) {
+      memcpy(&length, _pos, sizeof(length));
+      length = le32toh(length);
+    }
+    if (left < sizeof(length) || left - sizeof(length) < length) {
+      _truncated = left != 0;
+      _record = {};
+      _pos = _end;
+      return false;
+    }
+    _record = string_view(_pos + sizeof(length), length);
+    _pos += sizeof(length) + length;
+    return _pos != _end;
+  }
+
+  inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override {
+    switch (get_suspend_point()) {
+    case 0:
+      process_resume(get_caller(), call_data);
+
+      while (next_record()) {
+        return prepare_to_suspend(1, get_caller(), _record);
+    case 1:
+        process_resume(get_caller(), call_data);
+      }
+
+      return prepare_to_suspend(_sp_done, get_caller(), _record);
+
+    default:
+      assert(false && "Called a completed coroutine");
+      return {};
+    }
+  }
+
+  const char* _pos;
+  const char* _end;
+  format _format;
+  string_view _record;
+  bool _truncated = false;
+};
+
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <assert.h>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Packed frames - a `coroutine_state` whose locals share storage when
+// they are never live across the same suspend point.
+//
+// In the translations so far every local gets its own `union`, so the
+// frame holds all of them for the coroutine's whole life. A packed frame
+// only holds the locals that are live across a suspend point, and only
+// while suspended there: the body keeps its locals in plain variables,
+// declared before the `switch`, saves the ones that are live across a
+// suspend point into the frame just before suspending, and loads them
+// back just after resuming:
+//
+//   `_temp2 = r2()` with `_temp1` live across it   >>>
+//   ```
+//     __state.save<temp1>(_temp1);
+//     return prepare_to_suspend(2, r2.get_cont());
+//   case 2:
+//     _temp1 = __state.load<temp1>();
+//     _temp2 = process_resume<int>(r2.get_cont(), call_data);
+//   ```
+//
+// A coroutine is suspended at one point at a time, so locals that are
+// live across disjoint sets of suspend points can overlay each other.
+// Each local is described by a `cps_frame_slot` listing the suspend
+// points it is live across, i.e. those where it is saved. A local live
+// across none takes no storage and is never saved; it may be listed to
+// keep the slots in step with the pseudo-code. `cps_frame` lays the
+// slots out at compile time, largest alignment first, each at the lowest
+// offset that does not overlap a slot it conflicts with.
+//
+// A value yielded by address (see `cps_wire`) must stay in the frame
+// while suspended, so it is saved before and loaded after the yield like
+// any other local that is live across it.
+
+template<class T, int... SuspendPoints> struct cps_frame_slot {
+  static_assert(((SuspendPoints > 0 && SuspendPoints < 64) && ...),
+                "Suspend points of a packed frame must be between 1 and 63");
+
+  using type = T;
+  constexpr static uint64_t live_across = ((uint64_t(1) << SuspendPoints) | ... | uint64_t(0));
+};
+
+template<class... Slots> class cps_frame {
+  constexpr static size_t slot_count = sizeof...(Slots);
+
+  struct layout {
+    size_t offsets[slot_count ? slot_count : 1] = {};
+    size_t size = 0;
+    size_t align = 1;
+  };
+
+  constexpr static size_t align_up(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+  }
+
+  constexpr static layout pack() {
+    const size_t sizes[] = { sizeof(typename Slots::type)..., 0 };
+    const size_t aligns[] = { alignof(typename Slots::type)..., 1 };
+    const uint64_t live[] = { Slots::live_across..., 0 };
+
+    // Largest alignment first, then largest size; stable otherwise.
+    size_t order[slot_count ? slot_count : 1] = {};
+    for (size_t i = 0; i < slot_count; ++i) {
+      size_t j = i;
+      for (; j > 0; --j) {
+        size_t prev = order[j - 1];
+        if (aligns[prev] > aligns[i] || (aligns[prev] == aligns[i] && sizes[prev] >= sizes[i]))
+          break;
+        order[j] = prev;
+      }
+      order[j] = i;
+    }
+
+    layout result;
+    for (size_t n = 0; n < slot_count; ++n) {
+      const size_t i = order[n];
+      if (!live[i])
+        continue;
+
+      // First fit among the ends of the conflicting slots placed so far.
+      size_t best = SIZE_MAX;
+      for (size_t c = 0; c <= n; ++c) {
+        size_t candidate = 0;
+        if (c < n) {
+          const size_t j = order[c];
+          if (!(live[i] & live[j]))
+            continue;
+          candidate = align_up(result.offsets[j] + sizes[j], aligns[i]);
+        }
+
+        bool fits = true;
+        for (size_t p = 0; p < n && fits; ++p) {
+          const size_t j = order[p];
+          if ((live[i] & live[j]) && candidate < result.offsets[j] + sizes[j] &&
+              result.offsets[j] < candidate + sizes[i])
+            fits = false;
+        }
+        if (fits && candidate < best)
+          best = candidate;
+      }
+
+      result.offsets[i] = best;
+      result.size = result.size > best + sizes[i] ? result.size : best + sizes[i];
+      result.align = result.align > aligns[i] ? result.align : aligns[i];
+    }
+    result.size = align_up(result.size, result.align);
+    return result;
+  }
+
+  // What a `coroutine_state` with one `union` per local takes.
+  constexpr static size_t unpack() {
+    size_t size = 0;
+    size_t align = 1;
+    ((size = align_up(size, alignof(typename Slots::type)) + sizeof(typename Slots::type),
+      align = align > alignof(typename Slots::type) ? align : alignof(typename Slots::type)), ...);
+    return align_up(size, align);
+  }
+
+  constexpr static layout _layout = pack();
+
+public:
+  template<size_t I> using type = tuple_element_t<I, tuple<typename Slots::type...>>;
+
+  // Bytes of storage, packed and with one slot per local.
+  constexpr static size_t size = _layout.size;
+  constexpr static size_t unpacked_size = unpack();
+
+  template<size_t I> constexpr static size_t offset = _layout.offsets[I];
+
+  cps_frame() {}
+  cps_frame(const cps_frame&) = delete;
+  cps_frame& operator=(const cps_frame&) = delete;
+
+  // The local in slot `I`, which must have been saved and not loaded
+  // since.
+  template<size_t I> type<I>& get() {
+    return *launder(reinterpret_cast<type<I>*>(_storage + offset<I>));
+  }
+
+  template<size_t I, class... A> type<I>& save(A&&... args) {
+    static_assert(tuple_element_t<I, tuple<Slots...>>::live_across != 0,
+                  "Saved a local that is not live across any suspend point");
+    return *new (_storage + offset<I>) type<I>(std::forward<A>(args)...);
+  }
+
+  // Moves the local out of slot `I` and destroys what is left of it.
+  template<size_t I> type<I> load() {
+    type<I>& slot = get<I>();
+    type<I> value(std::move(slot));
+    slot.~type<I>();
+    return value;
+  }
+
+  // Destroys the local in slot `I` without loading it, as a coroutine
+  // destroyed while suspended must for the locals it saved.
+  template<size_t I> void destroy() {
+    get<I>().~type<I>();
+  }
+
+private:
+  alignas(_layout.align) unsigned char _storage[size ? size : 1];
+};
+
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Cross-thread handoff - moves suspended coroutines from one
+// thread to another through lock-free queues.
+//
+// A continuation is a plain `cps_target*`, so resuming one on another
+// thread is only safe once everything its body wrote before suspending
+// is visible there. The queues publish each entry with a release store
+// and take it with an acquire load, which orders the frame state of the
+// suspended coroutine along with it.
+//
+// A body hands itself over by suspending to the queue:
+//
+//   `park(q)`   >>>
+//   ```
+//     return prepare_to_suspend(N, q.park());
+//   case N:
+//   ```
+//
+// The queue's target receives the suspended coroutine as its
+// `call_data.cont` and pushes it. As with `scheduler::yield_to_scheduler()`
+// the continuation is re-armed on every call, so no `process_resume` is
+// needed; the body continues on whichever thread calls `resume_one()`.
+//
+// Coroutines that travel through a queue must only be resumed through
+// `resume_one()`, never through their `operator()`: the latter writes the
+// coroutine's continuation after the trampoline returns, by which time
+// the coroutine may already be running elsewhere.
+
+class continuation_handoff {
+protected:
+  static cps_target* peek(const resume_continuation<>& cont) {
+    return cont._target;
+  }
+
+  static cps_target* take(resume_continuation<>& cont) {
+    return cont.release();
+  }
+
+  // The thread's continuation for suspending to `target`, re-armed on every
+  // call. It is consumed by `prepare_to_suspend` straight away, so a single
+  // one per thread is enough.
+  static resume_continuation<void()>& arm(cps_target* target) {
+    thread_local resume_continuation<void()> cont;
+    cont = resume_continuation<void()>(target);
+    return cont;
+  }
+
+  static void resume(cps_target* target) {
+    cps_run_loop::run(target, {});
+  }
+
+  // Pushes whatever suspends to it on `Queue`, waiting for room if the
+  // queue is full.
+  template<class Queue> class park_target : public cps_target {
+  public:
+    explicit park_target(Queue& queue) : _queue(queue) {}
+
+    cps_call_data __body(cps_call_data call_data) override {
+      while (!_queue.try_push(call_data.cont))
+        this_thread::yield();
+      return {{}, nullptr};
+    }
+
+  private:
+    Queue& _queue;
+  };
+};
+
+// Common interface of the queues below; `Queue` provides
+// `try_push(cps_target*)` and `try_pop()`.
+template<class Queue> class handoff_queue : public continuation_handoff {
+public:
+  // Transfers ownership of `cont` to the queue. When the queue is full,
+  // returns false and leaves `cont` untouched.
+  bool push(resume_continuation<>& cont) {
+    assert(cont.is_valid());
+    if (!self().try_push(peek(cont)))
+      return false;
+    take(cont);
+    return true;
+  }
+
+  // Queues a coroutine that has not been started, or that parked by
+  // returning to whoever resumed it.
+  template<class C> requires is_base_of_v<coroutine<>, C>
+  bool push(C& coro) {
+    return self().try_push(static_cast<cps_target*>(&coro));
+  }
+
+  // Resumes the oldest queued coroutine on the calling thread, until it
+  // suspends again. Returns false when the queue was empty.
+  bool resume_one() {
+    cps_target* target = self().try_pop();
+    if (!target)
+      return false;
+    resume(target);
+    return true;
+  }
+
+  // The continuation a body suspends to in order to be queued; see above.
+  resume_continuation<void()>& park() {
+    return arm(&_park);
+  }
+
+private:
+  Queue& self() { return static_cast<Queue&>(*this); }
+
+  park_target<Queue> _park{self()};
+};
+
+// Single producer, single consumer. Each side caches the other side's
+// index, so an uncontended push or pop touches a single shared line.
+template<size_t Capacity> class spsc_handoff_queue : public handoff_queue<spsc_handoff_queue<Capacity>> {
+  static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  spsc_handoff_queue() = default;
+  spsc_handoff_queue(const spsc_handoff_queue&) = delete;
+  spsc_handoff_queue& operator=(const spsc_handoff_queue&) = delete;
+
+  bool try_push(cps_target* target) {
+    assert(target != nullptr);
+    size_t tail = _tail.load(memory_order_relaxed);
+    if (tail - _head_cache == Capacity) {
+      _head_cache = _head.load(memory_order_acquire);
+      if (tail - _head_cache == Capacity)
+        return false;
+    }
+
+    _slots[tail & (Capacity - 1)] = target;
+    _tail.store(tail + 1, memory_order_release);
+    return true;
+  }
+
+  cps_target* try_pop() {
+    size_t head = _head.load(memory_order_relaxed);
+    if (head == _tail_cache) {
+      _tail_cache = _tail.load(memory_order_acquire);
+      if (head == _tail_cache)
+        return nullptr;
+    }
+
+    cps_target* target = _slots[head & (Capacity - 1)];
+    _head.store(head + 1, memory_order_release);
+    return target;
+  }
+
+private:
+  // Producer side
+  alignas(64) atomic<size_t> _tail{0};
+  size_t _head_cache = 0;
+
+  // Consumer side
+  alignas(64) atomic<size_t> _head{0};
+  size_t _tail_cache = 0;
+
+  alignas(64) cps_target* _slots[Capacity];
+};
+
+// Multiple producers, single consumer (Vyukov's bounded queue). Each slot
+// carries a sequence number telling whether it is free for the producer
+// at that position or filled for the consumer.
+template<size_t Capacity> class mpsc_handoff_queue : public handoff_queue<mpsc_handoff_queue<Capacity>> {
+  static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  mpsc_handoff_queue() {
+    for (size_t i = 0; i < Capacity; ++i)
+      _cells[i].sequence.store(i, memory_order_relaxed);
+  }
+
+  mpsc_handoff_queue(const mpsc_handoff_queue&) = delete;
+  mpsc_handoff_queue& operator=(const mpsc_handoff_queue&) = delete;
+
+  bool try_push(cps_target* target) {
+    assert(target != nullptr);
+    size_t pos = _enqueue.load(memory_order_relaxed);
+    cell* c;
+    for (;;) {
+      c = &_cells[pos & (Capacity - 1)];
+      size_t sequence = c->sequence.load(memory_order_acquire);
+      intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+      if (diff == 0) {
+        if (_enqueue.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = _enqueue.load(memory_order_relaxed);
+      }
+    }
+
+    c->target = target;
+    c->sequence.store(pos + 1, memory_order_release);
+    return true;
+  }
+
+  cps_target* try_pop() {
+    cell& c = _cells[_dequeue & (Capacity - 1)];
+    if (c.sequence.load(memory_order_acquire) != _dequeue + 1)
+      return nullptr;
+
+    cps_target* target = c.target;
+    c.sequence.store(_dequeue + Capacity, memory_order_release);
+    ++_dequeue;
+    return target;
+  }
+
+private:
+  struct cell {
+    atomic<size_t> sequence;
+    cps_target* target;
+  };
+
+  alignas(64) atomic<size_t> _enqueue{0};
+  alignas(64) size_t _dequeue = 0;
+  alignas(64) cell _cells[Capacity];
+};
+
+};
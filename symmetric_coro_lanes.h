@@ -0,0 +1,139 @@
+#pragma once
+
+#include <assert.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Lane-parallel coroutines - many instances of one coroutine type, with
+// their state in struct-of-arrays form, stepped in lockstep with SIMD
+// vectors.
+//
+// Instances are lanes. Each piece of state is an array of vectors, one
+// per chunk of `lane_width` lanes, and so is the suspend point. The body
+// is written for one chunk at a time: it is given the suspend point the
+// lanes it steps are at, and a mask (all bits set or clear per lane) of
+// which lanes of the chunk those are. It updates the state with
+// `mask ? new : old`, so that other lanes keep theirs, and returns the
+// values the lanes yield.
+//
+// `step()` groups the lanes of a chunk by suspend point and runs the body
+// once per group, so lanes that diverge only cost an extra pass for as
+// long as they stay apart; data-dependent branches inside a body are
+// masked as well. Lanes that are done are not stepped again.
+//
+// Resuming another lane coroutine with the same lane count is a masked
+// `step()` of the same chunk, a direct call: lanes of a consumer only
+// ever talk to the same lanes of their producers.
+//
+// Vectors are GCC vector extensions, as wide as the target allows: 64
+// bytes with AVX-512, 32 with AVX2 and 16 otherwise. Build with
+// -march=native (or -mavx2, -mavx512f) to use the wider ones. Lane
+// values are 32 bits.
+
+#if defined(__AVX512F__)
+constexpr size_t lane_vector_bytes = 64;
+#elif defined(__AVX2__)
+constexpr size_t lane_vector_bytes = 32;
+#else
+constexpr size_t lane_vector_bytes = 16;
+#endif
+
+constexpr size_t lane_width = lane_vector_bytes / sizeof(int32_t);
+
+typedef int32_t lane_int __attribute__((vector_size(lane_vector_bytes)));
+
+// A lane mask is a `lane_int` with all bits set in the selected lanes, as
+// produced by vector comparisons.
+typedef lane_int lane_mask;
+
+inline bool lane_any(lane_mask mask) {
+  for (size_t k = 0; k < lane_width; ++k)
+    if (mask[k])
+      return true;
+  return false;
+}
+
+// Lane coroutines derive from `lane_coroutine<Derived, Lanes>` and define
+//
+//   lane_int __lanes_body(size_t chunk, suspend_point sp, lane_mask group);
+//
+// which steps the lanes of `chunk` selected by `group`, all at `sp`.
+template<class Derived, size_t Lanes> class lane_coroutine {
+  static_assert(Lanes % lane_width == 0, "Lane count must be a multiple of lane_width");
+
+public:
+  using suspend_point = int;
+
+  constexpr static size_t lane_count = Lanes;
+  constexpr static size_t chunk_count = Lanes / lane_width;
+
+  lane_coroutine() {
+    for (lane_int& sp : _sp)
+      sp = lane_int{} + 0;
+  }
+
+  bool done(size_t lane) const {
+    return _sp[lane / lane_width][lane % lane_width] == _sp_done;
+  }
+
+  lane_mask done_mask(size_t chunk) const {
+    return _sp[chunk] == _sp_done;
+  }
+
+  bool all_done() const {
+    for (size_t c = 0; c < chunk_count; ++c)
+      if (lane_any(_sp[c] != _sp_done))
+        return false;
+    return true;
+  }
+
+  // Resumes the lanes of `chunk` selected by `active` that are not done,
+  // until each of them yields or returns. Returns the values they
+  // produced, and 0 in the other lanes.
+  lane_int step(size_t chunk, lane_mask active) {
+    assert(chunk < chunk_count);
+    active &= _sp[chunk] != _sp_done;
+
+    lane_int values = {};
+    while (lane_any(active)) {
+      suspend_point sp = first_selected(_sp[chunk], active);
+      lane_mask group = active & (_sp[chunk] == sp);
+      lane_int produced = self().__lanes_body(chunk, sp, group);
+      values = group ? produced : values;
+      active &= ~group;
+    }
+    return values;
+  }
+
+  // Steps every lane that is not done once; `values[chunk]` receives what
+  // the lanes of each chunk produced.
+  void step(lane_int* values) {
+    for (size_t c = 0; c < chunk_count; ++c)
+      values[c] = step(c, lane_int{} - 1);
+  }
+
+protected:
+  // Moves the lanes of `chunk` selected by `group` to suspend point `sp`,
+  // lane by lane.
+  void prepare_to_suspend(size_t chunk, lane_mask group, lane_int sp) {
+    _sp[chunk] = group ? sp : _sp[chunk];
+  }
+
+  constexpr static suspend_point _sp_done = -1;
+
+private:
+  Derived& self() { return static_cast<Derived&>(*this); }
+
+  static suspend_point first_selected(lane_int sp, lane_mask mask) {
+    for (size_t k = 0; k < lane_width; ++k)
+      if (mask[k])
+        return sp[k];
+    return _sp_done;
+  }
+
+  lane_int _sp[chunk_count];
+};
+
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <assert.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Hardware performance counters - `perf_event_open` around a region of
+// code or a single trampoline run, to see what a hop costs in
+// instructions, mispredicted branches and cache misses.
+//
+//   perf_counters counters;
+//   perf_sample s = counters.measure([&] { ... });      // a region
+//   perf_sample h = counters.measure_run(&coro);        // per hop
+//   printf("IPC %.2f, %.2f mispredicts/hop\n", h.ipc(), h[perf_counter::branch_misses]);
+//
+// Counters are opened for the calling thread only and count user space
+// only. They are read together as one group, and a counter that cannot
+// be opened (`perf_event_paranoid`, a VM without a PMU) is left out of it
+// rather than failing the rest; `has()` tells which ones were counted.
+// Counts are scaled when the kernel had to multiplex the group.
+
+enum class perf_counter : unsigned {
+  cycles,
+  instructions,
+  branches,
+  branch_misses,
+  l1d_read_misses,
+  // Nanoseconds on the CPU; a software counter, so normally available.
+  task_clock,
+  count,
+};
+
+struct perf_sample {
+  constexpr static unsigned counter_count = unsigned(perf_counter::count);
+
+  bool has(perf_counter c) const {
+    return valid & (1u << unsigned(c));
+  }
+
+  // NaN when the counter was not available.
+  double operator[](perf_counter c) const {
+    return has(c) ? values[unsigned(c)] : NAN;
+  }
+
+  double ipc() const {
+    return (*this)[perf_counter::instructions] / (*this)[perf_counter::cycles];
+  }
+
+  // The counts divided by `n`, e.g. per hop.
+  perf_sample per(double n) const {
+    perf_sample result = *this;
+    for (double& v : result.values)
+      v /= n;
+    return result;
+  }
+
+  double values[counter_count] = {};
+  unsigned valid = 0;
+};
+
+class perf_counters {
+public:
+  perf_counters() {
+    static const struct { uint32_t type; uint64_t config; } events[] = {
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+      { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+      { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    };
+    static_assert(sizeof(events) / sizeof(events[0]) == perf_sample::counter_count);
+
+    for (unsigned i = 0; i < perf_sample::counter_count; ++i) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = events[i].type;
+      attr.config = events[i].config;
+      attr.disabled = _leader < 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      // A counter that does not exist here, or that the PMU cannot
+      // schedule alongside the group, is left out.
+      int fd = open_event(attr, _leader);
+      if (fd < 0)
+        continue;
+      if (_leader < 0)
+        _leader = fd;
+      _fds[_opened] = fd;
+      _order[_opened++] = perf_counter(i);
+    }
+  }
+
+  perf_counters(const perf_counters&) = delete;
+  perf_counters& operator=(const perf_counters&) = delete;
+
+  ~perf_counters() {
+    for (unsigned i = 0; i < _opened; ++i)
+      close(_fds[i]);
+  }
+
+  // Whether any counter could be opened at all.
+  bool available() const {
+    return _opened != 0;
+  }
+
+  bool has(perf_counter c) const {
+    for (unsigned i = 0; i < _opened; ++i)
+      if (_order[i] == c)
+        return true;
+    return false;
+  }
+
+  void start() {
+    if (_leader < 0)
+      return;
+    ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  perf_sample stop() {
+    perf_sample sample;
+    if (_leader < 0)
+      return sample;
+    ioctl(_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    struct {
+      uint64_t count;
+      uint64_t time_enabled;
+      uint64_t time_running;
+      uint64_t values[perf_sample::counter_count];
+    } data;
+    if (read(_leader, &data, sizeof(data)) < ssize_t(3 * sizeof(uint64_t)) || data.time_running == 0)
+      return sample;
+
+    const double scale = double(data.time_enabled) / double(data.time_running);
+    for (unsigned i = 0; i < data.count && i < _opened; ++i) {
+      sample.values[unsigned(_order[i])] = double(data.values[i]) * scale;
+      sample.valid |= 1u << unsigned(_order[i]);
+    }
+    return sample;
+  }
+
+  template<class F>
+  perf_sample measure(F&& f) {
+    start();
+    f();
+    return stop();
+  }
+
+  // Runs `target` through a trampoline, as `scheduler::spawn` would, and
+  // returns the counts per hop. The loop is `cps_target::trampoline`
+  // without its instrumentation and tracing hooks, plus one increment per
+  // hop to count them.
+  perf_sample measure_run(cps_target* target, cps_target::cps_arg arg = {}) {
+    assert(target != nullptr);
+    cps_target* callee = target;
+    cps_target::cps_arg data = arg;
+    cps_target* cont = nullptr;
+    uint64_t hops = 0;
+
+    start();
+    while (callee != nullptr) {
+      cps_target::cps_call_data call_data = callee->__body({data, cont});
+      ++hops;
+      cont = callee;
+      callee = call_data.cont;
+      data = call_data.data;
+    }
+    return stop().per(double(hops));
+  }
+
+private:
+  static int open_event(perf_event_attr& attr, int group) {
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC));
+  }
+
+  int _leader = -1;
+  unsigned _opened = 0;
+  int _fds[perf_sample::counter_count];
+  perf_counter _order[perf_sample::counter_count];
+};
+
+};
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdlib.h>
+#include <utility>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Frame allocation - coroutine objects never move once created
+// (their continuations point at them), so short-lived ones are
+// placed in recycled slots instead of being allocated one by one.
+
+// Per-thread allocator with size-class free lists carved out of large
+// slabs. Slabs are only returned to the system when the thread exits, so
+// every frame must be released before the thread that allocated it exits.
+// Frames can be released on another thread: each slab records the
+// allocator that owns it, and a slot released elsewhere goes on that
+// allocator's lock-free remote list, which the owner takes over whole
+// once one of its free lists runs dry.
+class frame_allocator {
+public:
+  constexpr static size_t granularity = 16;
+  constexpr static size_t max_frame_size = 1024;
+  constexpr static size_t slab_size = 64 * 1024;
+
+  static frame_allocator& local() {
+    thread_local frame_allocator allocator;
+    return allocator;
+  }
+
+  frame_allocator() = default;
+  frame_allocator(const frame_allocator&) = delete;
+  frame_allocator& operator=(const frame_allocator&) = delete;
+
+  ~frame_allocator() {
+    while (_slabs) {
+      slab* next = _slabs->next;
+      free(_slabs);
+      _slabs = next;
+    }
+  }
+
+  void* allocate(size_t size) {
+    if (size > max_frame_size)
+      return ::operator new(size);
+
+    size_class& c = _classes[class_index(size)];
+    if (!c.free_list && _remote.load(memory_order_relaxed))
+      reclaim();
+    if (free_slot* slot = c.free_list) {
+      c.free_list = slot->next;
+      return slot;
+    }
+
+    const size_t slot_size = (class_index(size) + 1) * granularity;
+    if (c.bump + slot_size > c.bump_end)
+      refill(c);
+
+    void* p = c.bump;
+    c.bump += slot_size;
+    return p;
+  }
+
+  void deallocate(void* p, size_t size) {
+    if (size > max_frame_size) {
+      ::operator delete(p);
+      return;
+    }
+
+    const size_t index = class_index(size);
+    frame_allocator* owner = slab_of(p)->owner;
+    if (owner == this) {
+      size_class& c = _classes[index];
+      c.free_list = new (p) free_slot{c.free_list, index};
+      return;
+    }
+
+    free_slot* slot = new (p) free_slot{owner->_remote.load(memory_order_relaxed), index};
+    while (!owner->_remote.compare_exchange_weak(slot->next, slot, memory_order_release, memory_order_relaxed))
+      ;
+  }
+
+private:
+  // A free slot remembers its size class, for when it comes back through
+  // the remote list.
+  struct free_slot {
+    free_slot* next;
+    size_t index;
+  };
+
+  // Slabs are aligned to their size, so a slot finds its slab's header.
+  struct slab {
+    slab* next;
+    frame_allocator* owner;
+  };
+
+  static_assert(sizeof(free_slot) <= granularity && sizeof(slab) <= granularity);
+
+  struct size_class {
+    free_slot* free_list = nullptr;
+    char* bump = nullptr;
+    char* bump_end = nullptr;
+  };
+
+  constexpr static size_t class_count = max_frame_size / granularity;
+
+  static size_t class_index(size_t size) {
+    return (size + granularity - 1) / granularity - (size != 0);
+  }
+
+  static slab* slab_of(void* p) {
+    return reinterpret_cast<slab*>(reinterpret_cast<uintptr_t>(p) & ~(slab_size - 1));
+  }
+
+  // Moves the slots released on other threads to their free lists.
+  void reclaim() {
+    free_slot* slot = _remote.exchange(nullptr, memory_order_acquire);
+    while (slot) {
+      free_slot* next = slot->next;
+      size_class& c = _classes[slot->index];
+      slot->next = c.free_list;
+      c.free_list = slot;
+      slot = next;
+    }
+  }
+
+  void refill(size_class& c) {
+    slab* s = static_cast<slab*>(aligned_alloc(slab_size, slab_size));
+    if (!s)
+      throw bad_alloc();
+
+    s->next = _slabs;
+    s->owner = this;
+    _slabs = s;
+
+    c.bump = reinterpret_cast<char*>(s) + granularity;
+    c.bump_end = reinterpret_cast<char*>(s) + slab_size;
+  }
+
+  size_class _classes[class_count];
+  slab* _slabs = nullptr;
+
+  // Pushed to by other threads, apart from what only this one touches.
+  alignas(64) atomic<free_slot*> _remote{nullptr};
+};
+
+// Creates coroutines of type `T` in slots of the calling thread's
+// `frame_allocator`; destroying the returned pointer recycles the slot.
+//
+//   auto r = coroutine_pool<range>::create(0, 10);
+//   while (!r->done())
+//     consume((*r)());
+template<class T> class coroutine_pool {
+  static_assert(alignof(T) <= frame_allocator::granularity, "Over-aligned coroutine type");
+
+public:
+  struct deleter {
+    void operator()(T* coro) const {
+      coro->~T();
+      frame_allocator::local().deallocate(coro, sizeof(T));
+    }
+  };
+
+  using pointer = unique_ptr<T, deleter>;
+
+  template<class... Args>
+  static pointer create(Args&&... args) {
+    void* slot = frame_allocator::local().allocate(sizeof(T));
+    return pointer(new (slot) T(std::forward<Args>(args)...));
+  }
+};
+
+// Bump allocator for all the coroutines of one request. `release()`
+// destroys them in reverse order of creation and keeps the memory for the
+// next request, so a steady stream of requests does not allocate.
+class frame_arena {
+public:
+  constexpr static size_t chunk_size = 16 * 1024;
+
+  frame_arena() = default;
+  frame_arena(const frame_arena&) = delete;
+  frame_arena& operator=(const frame_arena&) = delete;
+
+  ~frame_arena() {
+    release();
+    for (chunk* c = _first; c;) {
+      chunk* next = c->next;
+      free(c);
+      c = next;
+    }
+  }
+
+  template<class T, class... Args>
+  T& create(Args&&... args) {
+    if constexpr (is_trivially_destructible_v<T>) {
+      return *new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    } else {
+      T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+      _destructors = new (allocate(sizeof(destructor), alignof(destructor))) destructor{
+        object, [](void* p) { static_cast<T*>(p)->~T(); }, _destructors};
+      return *object;
+    }
+  }
+
+  // Destroys every coroutine created since the last release.
+  void release() {
+    for (destructor* d = _destructors; d; d = d->next)
+      d->destroy(d->object);
+    _destructors = nullptr;
+
+    _current = _first;
+    _bump = _first ? _first->data() : nullptr;
+    _bump_end = _first ? _first->end() : nullptr;
+  }
+
+private:
+  struct chunk {
+    chunk* next;
+    size_t size;
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+    char* end() { return reinterpret_cast<char*>(this) + size; }
+  };
+
+  struct destructor {
+    void* object;
+    void (*destroy)(void*);
+    destructor* next;
+  };
+
+  void* allocate(size_t size, size_t align) {
+    assert(align <= alignof(max_align_t));
+
+    char* p = align_up(_bump, align);
+    while (!p || p + size > _bump_end) {
+      next_chunk(size + align);
+      p = align_up(_bump, align);
+    }
+
+    _bump = p + size;
+    return p;
+  }
+
+  static char* align_up(char* p, size_t align) {
+    return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~(align - 1));
+  }
+
+  // Moves to the next chunk, reusing the ones kept by `release()`.
+  void next_chunk(size_t min_size) {
+    chunk* c = _current ? _current->next : _first;
+    while (c && c->size - sizeof(chunk) < min_size)
+      c = c->next;
+
+    if (!c) {
+      size_t size = max(chunk_size, min_size + sizeof(chunk));
+      c = static_cast<chunk*>(aligned_alloc(alignof(max_align_t), (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1)));
+      if (!c)
+        throw bad_alloc();
+      c->size = size;
+
+      // Chained after the current chunk, so that `release()` keeps it.
+      chunk* tail = _current;
+      if (!tail) {
+        c->next = _first;
+        _first = c;
+      } else {
+        c->next = tail->next;
+        tail->next = c;
+      }
+    }
+
+    _current = c;
+    _bump = c->data();
+    _bump_end = c->end();
+  }
+
+  chunk* _first = nullptr;
+  chunk* _current = nullptr;
+  char* _bump = nullptr;
+  char* _bump_end = nullptr;
+  destructor* _destructors = nullptr;
+};
+
+};
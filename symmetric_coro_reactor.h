@@ -0,0 +1,365 @@
+#pragma once
+
+#include <assert.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <memory>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// I/O reactor - a single-threaded event loop on top of epoll that
+// resumes coroutines when the file descriptor they wait on becomes
+// readable or writable.
+//
+// A body waits for readiness by suspending to the reactor:
+//
+//   `wait_readable(fd)`   >>>
+//   ```
+//     return prepare_to_suspend(N, r.readable(fd));
+//   case N:
+//   ```
+//
+// and likewise with `writable(fd)`. As with the scheduler, the
+// continuation is re-armed on every call and needs no `process_resume`.
+//
+// File descriptors are registered once, edge-triggered, so a waiter is
+// only woken by readiness that appears after it got `EAGAIN`. Waiting
+// without having seen `EAGAIN` first may block forever; `fd_reader` and
+// `fd_writer` below follow that rule.
+
+class reactor {
+public:
+  constexpr static int max_events = 64;
+
+  reactor()
+    : _epoll_fd(epoll_create1(EPOLL_CLOEXEC))
+  {
+    if (_epoll_fd < 0)
+      throw system_error(errno, system_category(), "epoll_create1");
+  }
+
+  reactor(const reactor&) = delete;
+  reactor& operator=(const reactor&) = delete;
+
+  ~reactor() {
+    close(_epoll_fd);
+  }
+
+  // Makes `fd` non-blocking and watches it for readiness.
+  void add(int fd) {
+    assert(fd >= 0);
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+      throw system_error(errno, system_category(), "fcntl");
+
+    if (size_t(fd) >= _fds.size())
+      _fds.resize(fd + 1);
+    assert(!_fds[fd] && "File descriptor added twice");
+    _fds[fd].reset(new fd_state(*this));
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = fd;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+      throw system_error(errno, system_category(), "epoll_ctl");
+  }
+
+  // Stops watching `fd`. Nothing may be waiting on it.
+  void remove(int fd) {
+    assert(size_t(fd) < _fds.size() && _fds[fd]);
+    assert(!_fds[fd]->waiters[0].waiting && !_fds[fd]->waiters[1].waiting &&
+           "Removed a file descriptor with waiting coroutines");
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    _fds[fd].reset();
+  }
+
+  // Queues a coroutine to be resumed by the event loop.
+  void spawn(cps_target* target) {
+    assert(target != nullptr);
+    _ready.push_back(target);
+  }
+
+  template<class C> requires is_base_of_v<coroutine<>, C>
+  void spawn(C& coro) {
+    spawn(static_cast<cps_target*>(&coro));
+  }
+
+  // The continuations a body suspends to in order to wait for `fd`; see
+  // above.
+  resume_continuation<void()>& readable(int fd) {
+    return arm(waiter_for(fd, read_direction));
+  }
+
+  resume_continuation<void()>& writable(int fd) {
+    return arm(waiter_for(fd, write_direction));
+  }
+
+  // Runs until no coroutine is ready or waiting, or until `stop()`. Each
+  // `epoll_wait` collects every ready waiter before any of them is resumed.
+  void run() {
+    _stopped = false;
+    while (!_stopped) {
+      resume_ready();
+      if (_stopped || _waiting == 0)
+        break;
+      poll(-1);
+    }
+  }
+
+  // Resumes the ready coroutines, then polls once for at most `timeout_ms`
+  // and resumes the coroutines that became ready. Returns how many were
+  // resumed.
+  size_t run_once(int timeout_ms = 0) {
+    size_t resumed = resume_ready();
+    if (_waiting != 0) {
+      poll(timeout_ms);
+      resumed += resume_ready();
+    }
+    return resumed;
+  }
+
+  // Makes `run()` return once the coroutine calling it has suspended.
+  void stop() {
+    _stopped = true;
+  }
+
+  size_t waiting() const {
+    return _waiting;
+  }
+
+private:
+  enum direction { read_direction = 0, write_direction = 1 };
+
+  // Records whatever suspends to it as the waiter of one direction of
+  // one file descriptor.
+  class waiter_target : public cps_target {
+  public:
+    explicit waiter_target(reactor& r) : _reactor(r) {}
+
+    cps_call_data __body(cps_call_data call_data) override {
+      assert(!waiting && "Two coroutines waiting on the same fd and direction");
+      waiting = call_data.cont;
+      ++_reactor._waiting;
+      return {{}, nullptr};
+    }
+
+    cps_target* waiting = nullptr;
+
+  private:
+    reactor& _reactor;
+  };
+
+  struct fd_state {
+    explicit fd_state(reactor& r) : waiters{waiter_target(r), waiter_target(r)} {}
+
+    waiter_target waiters[2];
+  };
+
+  waiter_target* waiter_for(int fd, direction d) {
+    assert(size_t(fd) < _fds.size() && _fds[fd] && "File descriptor not added");
+    return &_fds[fd]->waiters[d];
+  }
+
+  static resume_continuation<void()>& arm(cps_target* target) {
+    thread_local resume_continuation<void()> cont;
+    cont = resume_continuation<void()>(target);
+    return cont;
+  }
+
+  void wake(waiter_target& w) {
+    if (cps_target* target = w.waiting) {
+      w.waiting = nullptr;
+      --_waiting;
+      _ready.push_back(target);
+    }
+  }
+
+  void poll(int timeout_ms) {
+    epoll_event events[max_events];
+    int n = epoll_wait(_epoll_fd, events, max_events, timeout_ms);
+    if (n < 0) {
+      if (errno == EINTR)
+        return;
+      throw system_error(errno, system_category(), "epoll_wait");
+    }
+
+    for (int i = 0; i < n; ++i) {
+      fd_state& state = *_fds[events[i].data.fd];
+      const uint32_t mask = events[i].events;
+      // Errors and hang-ups wake both sides; the retried call reports them.
+      if (mask & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        wake(state.waiters[read_direction]);
+      if (mask & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+        wake(state.waiters[write_direction]);
+    }
+  }
+
+  size_t resume_ready() {
+    size_t resumed = 0;
+    while (!_ready.empty() && !_stopped) {
+      _batch.swap(_ready);
+      for (cps_target* target : _batch)
+        cps_run_loop::run(target, {});
+      resumed += _batch.size();
+      _batch.clear();
+    }
+    return resumed;
+  }
+
+  int _epoll_fd;
+  vector<unique_ptr<fd_state>> _fds;
+  vector<cps_target*> _ready;
+  vector<cps_target*> _batch;
+  size_t _waiting = 0;
+  bool _stopped = false;
+};
+
+///////////////////////////////////////////////////////////
+// Read and write helpers - coroutines that perform one call each time
+// they are resumed, waiting on the reactor while the fd would block.
+//
+//   `n = read(reader, buf, len)`   >>>
+//   ```
+//     reader.set_buffer(buf, len);
+//     return prepare_to_suspend(N, reader.get_cont());
+//   case N:
+//     n = process_resume<ssize_t>(reader.get_cont(), call_data);
+//   ```
+//
+// The result is the byte count, or `-errno` on failure (`errno` itself
+// does not survive the hops).
+
+// Reads whatever is available, up to the buffer size; 0 means end of file.
+class fd_reader : public coroutine<ssize_t()> {
+  friend struct cps_dispatch_access;
+
+public:
+  fd_reader(reactor& r, int fd)
+    : _reactor(r)
+    , _fd(fd)
+  {}
+
+  void set_buffer(void* buf, size_t len) {
+    _buf = buf;
+    _len = len;
+  }
+
+private:
+  inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override {
+    switch (get_suspend_point()) {
+    case 0:
+      process_resume(get_caller(), call_data);
+
+      for (;;) {
+        _result = ::read(_fd, _buf, _len);
+        if (_result < 0) {
+          if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return prepare_to_suspend(1, _reactor.readable(_fd));
+    case 1:
+            continue;
+          }
+          if (errno == EINTR)
+            continue;
+          _result = -errno;
+        }
+
+        return prepare_to_suspend(2, get_caller(), _result);
+    case 2:
+        process_resume(get_caller(), call_data);
+      }
+
+    default:
+      assert(false && "Called a completed coroutine");
+      return {};
+    }
+  }
+
+  reactor& _reactor;
+  int _fd;
+  void* _buf = nullptr;
+  size_t _len = 0;
+  ssize_t _result = 0;
+};
+
+// Writes the whole buffer, across as many calls as needed. Sockets are
+// written with `MSG_NOSIGNAL`, so a closed peer gives `-EPIPE`; a write
+// that takes nothing gives `-EIO`.
+class fd_writer : public coroutine<ssize_t()> {
+  friend struct cps_dispatch_access;
+
+public:
+  fd_writer(reactor& r, int fd)
+    : _reactor(r)
+    , _fd(fd)
+  {}
+
+  void set_buffer(const void* buf, size_t len) {
+    _buf = static_cast<const char*>(buf);
+    _len = len;
+  }
+
+private:
+  // Other fds get `write` once `send` has found they are no socket.
+  ssize_t write_some() {
+    if (_socket) {
+      ssize_t n = ::send(_fd, _buf + _result, _len - _result, MSG_NOSIGNAL);
+      if (n >= 0 || errno != ENOTSOCK)
+        return n;
+      _socket = false;
+    }
+    return ::write(_fd, _buf + _result, _len - _result);
+  }
+
+  inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override {
+    switch (get_suspend_point()) {
+    case 0:
+      process_resume(get_caller(), call_data);
+
+      for (;;) {
+        for (_result = 0; size_t(_result) < _len;) {
+          _written = write_some();
+          if (_written > 0) {
+            _result += _written;
+          } else if (_written == 0) {
+            // No progress and no error; the fd will take no more.
+            _result = -EIO;
+            break;
+          } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return prepare_to_suspend(1, _reactor.writable(_fd));
+    case 1:
+            ;
+          } else if (errno != EINTR) {
+            _result = -errno;
+            break;
+          }
+        }
+
+        return prepare_to_suspend(2, get_caller(), _result);
+    case 2:
+        process_resume(get_caller(), call_data);
+      }
+
+    default:
+      assert(false && "Called a completed coroutine");
+      return {};
+    }
+  }
+
+  reactor& _reactor;
+  int _fd;
+  bool _socket = true;
+  const char* _buf = nullptr;
+  size_t _len = 0;
+  ssize_t _written = 0;
+  ssize_t _result = 0;
+};
+
+};
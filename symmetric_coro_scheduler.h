@@ -0,0 +1,310 @@
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Work-stealing deque (Chase-Lev, with the memory orderings of
+// Le et al., "Correct and Efficient Work-Stealing for Weak Memory
+// Models"). The owner pushes and pops at the bottom, thieves take
+// from the top. Retired arrays are kept until the deque dies, as a
+// thief may still be reading from them.
+
+class work_stealing_deque {
+public:
+  explicit work_stealing_deque(int64_t capacity = 256)
+    : _array(new ring(capacity))
+  {
+    _retired.emplace_back(_array.load(memory_order_relaxed));
+  }
+
+  work_stealing_deque(const work_stealing_deque&) = delete;
+  work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+  // Owner only.
+  void push(cps_target* target) {
+    int64_t b = _bottom.load(memory_order_relaxed);
+    int64_t t = _top.load(memory_order_acquire);
+    ring* a = _array.load(memory_order_relaxed);
+
+    if (b - t > a->capacity - 1)
+      a = grow(a, b, t);
+
+    a->put(b, target);
+    // A release store rather than a release fence: the same ordering, and
+    // one that ThreadSanitizer can follow.
+    _bottom.store(b + 1, memory_order_release);
+  }
+
+  // Owner only.
+  cps_target* pop() {
+    int64_t b = _bottom.load(memory_order_relaxed) - 1;
+    ring* a = _array.load(memory_order_relaxed);
+    _bottom.store(b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = _top.load(memory_order_relaxed);
+
+    if (t > b) {
+      _bottom.store(b + 1, memory_order_relaxed);
+      return nullptr;
+    }
+
+    cps_target* target = a->get(b);
+    if (t == b) {
+      // Last element - race against thieves for it.
+      if (!_top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+        target = nullptr;
+      _bottom.store(b + 1, memory_order_relaxed);
+    }
+    return target;
+  }
+
+  // Any thread. Returns nullptr when empty or when losing a race.
+  cps_target* steal() {
+    int64_t t = _top.load(memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = _bottom.load(memory_order_acquire);
+
+    if (t >= b)
+      return nullptr;
+
+    ring* a = _array.load(memory_order_acquire);
+    cps_target* target = a->get(t);
+    if (!_top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+      return nullptr;
+    return target;
+  }
+
+  bool empty() const {
+    return _top.load(memory_order_relaxed) >= _bottom.load(memory_order_relaxed);
+  }
+
+private:
+  struct ring {
+    explicit ring(int64_t capacity)
+      : capacity(capacity)
+      , slots(new atomic<cps_target*>[capacity])
+    {
+      assert((capacity & (capacity - 1)) == 0 && "Capacity must be a power of two");
+    }
+
+    cps_target* get(int64_t i) const {
+      return slots[i & (capacity - 1)].load(memory_order_relaxed);
+    }
+
+    void put(int64_t i, cps_target* target) {
+      slots[i & (capacity - 1)].store(target, memory_order_relaxed);
+    }
+
+    const int64_t capacity;
+    unique_ptr<atomic<cps_target*>[]> slots;
+  };
+
+  ring* grow(ring* old, int64_t b, int64_t t) {
+    ring* a = new ring(old->capacity * 2);
+    _retired.emplace_back(a);
+    for (int64_t i = t; i < b; ++i)
+      a->put(i, old->get(i));
+    _array.store(a, memory_order_release);
+    return a;
+  }
+
+  alignas(64) atomic<int64_t> _top{0};
+  alignas(64) atomic<int64_t> _bottom{0};
+  atomic<ring*> _array;
+  vector<unique_ptr<ring>> _retired;
+};
+
+///////////////////////////////////////////////////////////
+// Work-stealing scheduler - runs ready coroutines through the
+// trampoline on a set of workers. Each worker owns a deque; idle
+// workers steal from randomly chosen victims.
+//
+// A scheduled coroutine that returns to its caller (the worker)
+// is parked: it runs again only when something spawns it again. To
+// let other coroutines run and be resumed later, a body suspends to
+// the scheduler instead:
+//
+//   `yield_to_scheduler()`   >>>
+//   ```
+//     return prepare_to_suspend(N, scheduler::yield_to_scheduler());
+//   case N:
+//   ```
+//
+// The scheduler's target receives the suspended coroutine as its
+// `call_data.cont` and pushes it on the current worker's deque. The
+// continuation is re-armed on every call, so the body does not need
+// `process_resume` for it.
+
+class scheduler {
+public:
+  explicit scheduler(unsigned worker_count = thread::hardware_concurrency())
+  {
+    worker_count = worker_count ? worker_count : 1;
+    for (unsigned i = 0; i < worker_count; ++i)
+      _workers.emplace_back(new worker(*this, i));
+  }
+
+  scheduler(const scheduler&) = delete;
+  scheduler& operator=(const scheduler&) = delete;
+
+  unsigned worker_count() const {
+    return unsigned(_workers.size());
+  }
+
+  // Makes `target` ready. From a worker it goes on that worker's deque,
+  // from any other thread on a shared injection queue.
+  void spawn(cps_target* target) {
+    assert(target != nullptr);
+    _pending.fetch_add(1, memory_order_relaxed);
+
+    if (_current && &_current->owner == this) {
+      _current->deque.push(target);
+    } else {
+      lock_guard<mutex> lock(_injected_mutex);
+      _injected.push_back(target);
+      _has_injected.store(true, memory_order_release);
+    }
+  }
+
+  template<class C> requires is_base_of_v<coroutine<>, C>
+  void spawn(C& coro) {
+    spawn(static_cast<cps_target*>(&coro));
+  }
+
+  // Runs the workers, one of them on the calling thread, until no
+  // coroutine is ready or running any more.
+  void run_until_idle() {
+    vector<thread> threads;
+    for (size_t i = 1; i < _workers.size(); ++i)
+      threads.emplace_back([this, i] { _workers[i]->run(); });
+
+    _workers[0]->run();
+
+    for (thread& t : threads)
+      t.join();
+  }
+
+  // The continuation a scheduled body suspends to in order to be resumed
+  // later; see above.
+  static resume_continuation<void()>& yield_to_scheduler() {
+    thread_local resume_continuation<void()> cont;
+    assert(_current && "yield_to_scheduler() outside of a scheduler worker");
+    cont = resume_continuation<void()>(&_current->rescheduler);
+    return cont;
+  }
+
+private:
+  struct worker;
+
+  // Pushes whatever suspended to it back on the current worker's deque.
+  class rescheduler_target : public cps_target {
+  public:
+    explicit rescheduler_target(worker& w) : _worker(w) {}
+
+    cps_call_data __body(cps_call_data call_data) override {
+      _worker.owner._pending.fetch_add(1, memory_order_relaxed);
+      _worker.deque.push(call_data.cont);
+      return {{}, nullptr};
+    }
+
+  private:
+    worker& _worker;
+  };
+
+  struct worker {
+    worker(scheduler& owner, unsigned index)
+      : owner(owner)
+      , index(index)
+      , rescheduler(*this)
+      , rng_state(index * 2654435761u + 1)
+    {}
+
+    // xorshift32 - victim selection only needs to be cheap and spread out.
+    unsigned next_random() {
+      rng_state ^= rng_state << 13;
+      rng_state ^= rng_state >> 17;
+      rng_state ^= rng_state << 5;
+      return rng_state;
+    }
+
+    void run() {
+      _current = this;
+
+      for (;;) {
+        cps_target* target = deque.pop();
+        if (!target)
+          target = owner.find_work(*this);
+
+        if (!target) {
+          if (owner._pending.load(memory_order_acquire) == 0)
+            break;
+          this_thread::yield();
+          continue;
+        }
+
+        cps_run_loop::run(target, {});
+        owner._pending.fetch_sub(1, memory_order_acq_rel);
+      }
+
+      _current = nullptr;
+    }
+
+    scheduler& owner;
+    const unsigned index;
+    work_stealing_deque deque;
+    rescheduler_target rescheduler;
+    uint32_t rng_state;
+  };
+
+  cps_target* find_work(worker& self) {
+    if (_has_injected.load(memory_order_acquire)) {
+      lock_guard<mutex> lock(_injected_mutex);
+      if (!_injected.empty()) {
+        // Take everything; keep one and queue the rest locally.
+        cps_target* target = _injected.back();
+        _injected.pop_back();
+        for (cps_target* t : _injected)
+          self.deque.push(t);
+        _injected.clear();
+        _has_injected.store(false, memory_order_relaxed);
+        return target;
+      }
+    }
+
+    const unsigned n = worker_count();
+    if (n == 1)
+      return nullptr;
+
+    // A few rounds of random victims before giving up for now.
+    for (unsigned attempt = 0; attempt < 2 * n; ++attempt) {
+      unsigned victim = self.next_random() % n;
+      if (victim == self.index)
+        continue;
+      if (cps_target* target = _workers[victim]->deque.steal())
+        return target;
+    }
+    return nullptr;
+  }
+
+  vector<unique_ptr<worker>> _workers;
+
+  // Coroutines that are queued or running.
+  alignas(64) atomic<size_t> _pending{0};
+
+  mutex _injected_mutex;
+  vector<cps_target*> _injected;
+  atomic<bool> _has_injected{false};
+
+  static inline thread_local worker* _current = nullptr;
+};
+
+};
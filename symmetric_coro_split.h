@@ -0,0 +1,191 @@
+#pragma once
+
+#include <assert.h>
+#include <concepts>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "symmetric_coro.h"
+#include "symmetric_coro_scheduler.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Splittable generators - generators that can hand part of their values
+// to a new generator before they start, so that the parts can be
+// consumed in parallel.
+//
+// A splittable generator `G` says how many values it will produce, and
+// has a splitting constructor that takes all but the first `keep` of
+// them from another one:
+//
+//   size_t size() const;              // before the first resume
+//   G(G& other, cps_split_t, size_t keep);
+//
+// where 0 < keep < other.size(). `other` then produces the first `keep`
+// values, and the new generator the rest, in order. A generator that
+// combines others, such as a zip, splits each of them at `keep`.
+//
+// `parallel_for_each` and `parallel_reduce` split a generator into pieces
+// and drain each piece from a coroutine spawned on a `scheduler`, so the
+// pieces run on its workers. Each piece is drained in order. Reductions
+// combine the pieces' results in order, for operations that are only
+// associative, or as each piece finishes, for ones that are commutative
+// as well. The callbacks run concurrently, one piece per worker at a
+// time. Both are called from outside the scheduler and return once every
+// piece is done; the generator passed in becomes the first piece.
+
+struct cps_split_t {};
+inline constexpr cps_split_t cps_split{};
+
+template<class G>
+concept splittable_generator = derived_from<G, coroutine<>> && constructible_from<G, G&, cps_split_t, size_t> &&
+  requires(const G& g) {
+    { g.size() } -> convertible_to<size_t>;
+  };
+
+// The values a generator produces.
+template<class G> using generator_value_t = decltype(declval<G&>()());
+
+enum class merge_order { ordered, unordered };
+
+struct partition_options {
+  // How many pieces to aim for; 0 means four per worker.
+  size_t pieces = 0;
+  // Pieces are not split below this many values.
+  size_t grain = 1024;
+};
+
+// Drains one piece, passing each value to `each`, then calls `finish`.
+template<class G, class Each, class Finish> class partition_task : public coroutine<void()> {
+  friend struct cps_dispatch_access;
+
+public:
+  partition_task(G& piece, Each each, Finish finish)
+    : _piece(piece)
+    , _each(std::move(each))
+    , _finish(std::move(finish))
+  {}
+
+private:
+  inline __attribute__((always_inline)) cps_call_data __body(cps_call_data call_data) override {
+    switch (get_suspend_point()) {
+    case 0:
+      process_resume(get_caller(), call_data);
+
+      do {
+        return prepare_to_suspend(1, _piece.get_cont());
+    case 1:
+        _each(process_resume<generator_value_t<G>>(_piece.get_cont(), call_data));
+      } while (!_piece.done());
+
+      _finish();
+      return prepare_to_suspend(_sp_done, get_caller());
+
+    default:
+      assert(false && "Called a completed coroutine");
+      return {};
+    }
+  }
+
+  G& _piece;
+  Each _each;
+  Finish _finish;
+};
+
+// Splits `gen` into pieces, kept in order in `order`; the new ones live in
+// `storage`. Each round splits every piece that is large enough in two.
+template<splittable_generator G>
+void split_pieces(G& gen, size_t pieces, size_t grain, deque<G>& storage, vector<G*>& order) {
+  order.assign(1, &gen);
+  grain = grain ? grain : 1;
+  while (order.size() < pieces) {
+    vector<G*> next;
+    for (size_t i = 0; i < order.size(); ++i) {
+      G* piece = order[i];
+      next.push_back(piece);
+      const size_t size = piece->size();
+      if (size >= 2 * grain && next.size() + (order.size() - i) <= pieces) {
+        storage.emplace_back(*piece, cps_split, size / 2);
+        next.push_back(&storage.back());
+      }
+    }
+    if (next.size() == order.size())
+      break;
+    order.swap(next);
+  }
+}
+
+// Spawns a `partition_task` per piece on `s` and runs it until idle.
+// `make_each(i)` and `make_finish(i)` give the callbacks of piece `i`.
+template<splittable_generator G, class MakeEach, class MakeFinish>
+void run_pieces(scheduler& s, G& gen, const partition_options& opts, MakeEach make_each, MakeFinish make_finish) {
+  assert(!gen.done() && gen.size() > 0 && "Split a finished or empty generator");
+
+  deque<G> storage;
+  vector<G*> order;
+  split_pieces(gen, opts.pieces ? opts.pieces : 4 * s.worker_count(), opts.grain, storage, order);
+
+  using each_t = decltype(make_each(size_t()));
+  using finish_t = decltype(make_finish(size_t()));
+  deque<partition_task<G, each_t, finish_t>> tasks;
+  for (size_t i = 0; i < order.size(); ++i) {
+    tasks.emplace_back(*order[i], make_each(i), make_finish(i));
+    s.spawn(tasks.back());
+  }
+  s.run_until_idle();
+}
+
+// Calls `f(value)` for every value of `gen`, concurrently across pieces.
+template<splittable_generator G, class F>
+void parallel_for_each(scheduler& s, G& gen, F f, const partition_options& opts = {}) {
+  run_pieces(s, gen, opts,
+             [&f](size_t) { return [&f](generator_value_t<G> value) { f(std::move(value)); }; },
+             [](size_t) { return [] {}; });
+}
+
+// Folds the values of `gen` into `init` with `op(T, T)`. Each piece
+// starts from its first value.
+template<splittable_generator G, class T, class Op>
+T parallel_reduce(scheduler& s, G& gen, T init, Op op, merge_order merge = merge_order::ordered,
+                  const partition_options& opts = {}) {
+  // One result per piece, apart so that pieces on different workers do
+  // not share a cache line.
+  struct alignas(64) piece_result {
+    optional<T> value;
+  };
+  deque<piece_result> results;
+  mutex merged_mutex;
+
+  auto make_each = [&](size_t) {
+    results.emplace_back();
+    return [&op, &result = results.back().value](generator_value_t<G> value) {
+      if (result)
+        result = op(std::move(*result), std::move(value));
+      else
+        result.emplace(std::move(value));
+    };
+  };
+
+  auto make_finish = [&](size_t i) {
+    return [&, i] {
+      if (merge == merge_order::unordered) {
+        lock_guard<mutex> lock(merged_mutex);
+        init = op(std::move(init), std::move(*results[i].value));
+      }
+    };
+  };
+
+  run_pieces(s, gen, opts, make_each, make_finish);
+
+  if (merge == merge_order::ordered)
+    for (piece_result& r : results)
+      init = op(std::move(init), std::move(*r.value));
+  return init;
+}
+
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Instrumentation - per-coroutine counters and a histogram of the
+// time spent in each `__body` activation.
+//
+// Compiled in with -DCPS_INSTRUMENTATION=1; otherwise `cps_target` has no
+// stats pointer and the trampoline and `prepare_to_suspend` carry no hooks.
+// Only targets given a `cps_stats` with `set_stats()` are measured:
+//
+//   cps_stats m_stats("multiply");
+//   m.set_stats(&m_stats);
+//   ... run the pipeline ...
+//   m_stats.print();
+//
+// The counters are plain integers, updated by whichever thread runs the
+// target. That is safe as long as a target only runs on one thread at a
+// time, which resuming it requires anyway.
+
+// Cheap timestamps: the TSC where there is one, nanoseconds otherwise.
+struct cps_clock {
+  static inline __attribute__((always_inline)) uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+  }
+
+  // Calibrated against `steady_clock` on first use, which takes ~10ms.
+  static double ns_per_tick() {
+#if defined(__x86_64__) || defined(__i386__)
+    static const double ratio = [] {
+      auto start = chrono::steady_clock::now();
+      uint64_t ticks = now();
+      while (chrono::steady_clock::now() - start < chrono::milliseconds(10))
+        ;
+      double ns = double(chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - start).count());
+      return ns / double(now() - ticks);
+    }();
+    return ratio;
+#else
+    return 1.0;
+#endif
+  }
+};
+
+// Log-linear histogram in the style of HdrHistogram: values below 16 have
+// a bucket each, larger ones 16 buckets per power of two, so a bucket is
+// within 6.25% of any value it holds.
+class cps_histogram {
+public:
+  constexpr static unsigned sub_bucket_bits = 4;
+  constexpr static unsigned sub_buckets = 1u << sub_bucket_bits;
+  constexpr static unsigned bucket_count = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+  void record(uint64_t value) {
+    ++_buckets[index_of(value)];
+    ++_count;
+    _total += value;
+    _min = value < _min ? value : _min;
+    _max = value > _max ? value : _max;
+  }
+
+  void reset() {
+    memset(_buckets, 0, sizeof(_buckets));
+    _count = _total = _max = 0;
+    _min = UINT64_MAX;
+  }
+
+  uint64_t count() const { return _count; }
+  uint64_t min() const { return _count ? _min : 0; }
+  uint64_t max() const { return _max; }
+  double mean() const { return _count ? double(_total) / double(_count) : 0.0; }
+
+  // Lower bound of the bucket holding the value at `percentile` (0-100),
+  // clamped to the recorded range; 100 is the exact maximum, as 0 is the
+  // minimum after clamping.
+  uint64_t percentile(double percentile) const {
+    if (_count == 0)
+      return 0;
+    if (percentile >= 100)
+      return _max;
+    uint64_t rank = uint64_t(percentile / 100.0 * double(_count - 1));
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < bucket_count; ++i) {
+      seen += _buckets[i];
+      if (seen > rank) {
+        uint64_t low = lower_bound_of(i);
+        return low < _min ? _min : low > _max ? _max : low;
+      }
+    }
+    return _max;
+  }
+
+  static unsigned index_of(uint64_t value) {
+    if (value < sub_buckets)
+      return unsigned(value);
+    unsigned exponent = 63 - unsigned(__builtin_clzll(value));
+    unsigned sub = unsigned(value >> (exponent - sub_bucket_bits)) & (sub_buckets - 1);
+    return (exponent - sub_bucket_bits + 1) * sub_buckets + sub;
+  }
+
+  static uint64_t lower_bound_of(unsigned index) {
+    if (index < sub_buckets)
+      return index;
+    unsigned exponent = index / sub_buckets + sub_bucket_bits - 1;
+    uint64_t sub = index % sub_buckets;
+    return (sub_buckets + sub) << (exponent - sub_bucket_bits);
+  }
+
+private:
+  uint64_t _buckets[bucket_count] = {};
+  uint64_t _count = 0;
+  uint64_t _total = 0;
+  uint64_t _min = UINT64_MAX;
+  uint64_t _max = 0;
+};
+
+class cps_stats {
+public:
+  explicit cps_stats(const char* name = "")
+    : name(name)
+  {}
+
+  const char* name;
+
+  // Activations of the target's `__body`.
+  uint64_t resumes = 0;
+  // Calls to `prepare_to_suspend`, including the final return.
+  uint64_t suspends = 0;
+  // Trampoline runs entered through the target, and the activations of
+  // any target they made.
+  uint64_t trampoline_calls = 0;
+  uint64_t trampoline_hops = 0;
+  // Time per timed activation, in `cps_clock` ticks.
+  cps_histogram body_ticks;
+
+  // Times one activation in every `period`, per thread; 1 times all of
+  // them. Counters stay exact either way.
+  static void set_sample_period(unsigned period) {
+    _sample_period = period ? period : 1;
+    _countdown = 1;
+  }
+
+  static unsigned sample_period() {
+    return _sample_period;
+  }
+
+  template<class Body>
+  inline __attribute__((always_inline)) auto time_activation(Body& body) {
+    ++resumes;
+    if (--_countdown != 0)
+      return body();
+
+    _countdown = _sample_period;
+    uint64_t start = cps_clock::now();
+    auto result = body();
+    body_ticks.record(cps_clock::now() - start);
+    return result;
+  }
+
+  // Counts the hops of one trampoline run.
+  class trampoline_scope {
+  public:
+    explicit trampoline_scope(cps_stats* stats) : _stats(stats) {}
+
+    ~trampoline_scope() {
+      if (_stats) {
+        ++_stats->trampoline_calls;
+        _stats->trampoline_hops += _hops;
+      }
+    }
+
+    void hop() { ++_hops; }
+
+  private:
+    cps_stats* _stats;
+    uint64_t _hops = 0;
+  };
+
+  void reset() {
+    resumes = suspends = trampoline_calls = trampoline_hops = 0;
+    body_ticks.reset();
+  }
+
+  void print(FILE* out = stdout) const {
+    const double ns = cps_clock::ns_per_tick();
+    fprintf(out, "%-16s resumes=%llu suspends=%llu", name,
+            (unsigned long long)resumes, (unsigned long long)suspends);
+    if (trampoline_calls)
+      fprintf(out, " hops/call=%.2f", double(trampoline_hops) / double(trampoline_calls));
+    if (body_ticks.count())
+      fprintf(out, " body: mean=%.1fns p50=%.1fns p99=%.1fns max=%.1fns (%llu timed)",
+              body_ticks.mean() * ns, double(body_ticks.percentile(50)) * ns,
+              double(body_ticks.percentile(99)) * ns, double(body_ticks.max()) * ns,
+              (unsigned long long)body_ticks.count());
+    fprintf(out, "\n");
+  }
+
+private:
+  static inline unsigned _sample_period = 1;
+  static inline thread_local unsigned _countdown = 1;
+};
+
+};
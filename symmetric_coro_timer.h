@@ -0,0 +1,332 @@
+#pragma once
+
+#include <assert.h>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Timing wheel - a hierarchical timing wheel (Varghese and Lauck,
+// "Hashed and Hierarchical Timing Wheels") that resumes coroutines once
+// their deadline has passed.
+//
+// A body sleeps by suspending to the wheel with a `timer` of its own:
+//
+//   `sleep_for(d)`   >>>
+//   ```
+//     return prepare_to_suspend(N, w.sleep_for(t, d));
+//   case N:
+//   ```
+//
+// and likewise with `sleep_until(tp)`. As with the reactor, the
+// continuation is re-armed on every call and needs no `process_resume`.
+//
+// Time advances in ticks, 1ms by default. Each of the `levels` levels has
+// `slots` slots, every one a list of timers; a timer goes in the finest
+// level whose span covers its deadline and moves down a level each time
+// the wheel turns past its slot, so inserting and cancelling a timer are a
+// list insert and unlink. A tick detaches its whole slot at once and
+// resumes the timers in it one after the other, through `cps_run_loop`.
+//
+// Deadlines are rounded up to a tick. `sleep_for` counts from the wheel's
+// own time, that of the last tick it processed, which `advance()` moves
+// forward to the clock; `run()` also sleeps until the next tick that may
+// resume something. Next to a reactor, poll for at most
+// `next_timeout_ms()` and advance the wheel after each poll.
+//
+// Timers belong to the coroutines that sleep on them, so sleeping
+// allocates nothing. A timer must not be destroyed while pending.
+
+class timer_wheel;
+
+// Links a timer into a slot; slots are the list heads.
+struct timer_link {
+  timer_link* prev = nullptr;
+  timer_link* next = nullptr;
+};
+
+// Records whatever suspends to it as the coroutine to resume at the
+// deadline it was armed with.
+class timer : public cps_target, private timer_link {
+public:
+  timer() = default;
+
+  timer(const timer&) = delete;
+  timer& operator=(const timer&) = delete;
+
+  ~timer() {
+    assert(!pending() && "Destroyed a pending timer");
+  }
+
+  bool pending() const {
+    return next != nullptr;
+  }
+
+  // Whether the last sleep on this timer lasted until its deadline, rather
+  // than being cancelled.
+  bool expired() const {
+    return _expired;
+  }
+
+private:
+  friend class timer_wheel;
+
+  cps_call_data __body(cps_call_data call_data) override;
+
+  timer_wheel* _wheel = nullptr;
+  cps_target* _waiter = nullptr;
+  uint64_t _deadline = 0;
+  bool _expired = false;
+};
+
+class timer_wheel {
+public:
+  using clock = chrono::steady_clock;
+
+  constexpr static unsigned slot_bits = 8;
+  constexpr static unsigned slots = 1u << slot_bits;
+  constexpr static unsigned levels = 4;
+
+  explicit timer_wheel(clock::duration tick = chrono::milliseconds(1))
+    : _tick(tick)
+    , _origin(clock::now())
+  {
+    assert(tick > clock::duration::zero());
+    for (auto& level : _slots)
+      for (timer_link& slot : level)
+        slot.prev = slot.next = &slot;
+  }
+
+  timer_wheel(const timer_wheel&) = delete;
+  timer_wheel& operator=(const timer_wheel&) = delete;
+
+  ~timer_wheel() {
+    assert(_pending == 0 && "Destroyed a timer wheel with pending timers");
+  }
+
+  // The continuations a body suspends to in order to sleep on `t`; see
+  // above.
+  resume_continuation<void()>& sleep_until(timer& t, clock::time_point deadline) {
+    return arm(t, ticks_at(deadline, true));
+  }
+
+  resume_continuation<void()>& sleep_for(timer& t, clock::duration d) {
+    return arm(t, _current + ticks_in(d, true));
+  }
+
+  // Stops `t` if it is pending. Returns the coroutine sleeping on it, for
+  // the caller to resume - at once, on a reactor or with `cps_run_loop` -
+  // or nullptr if there was none.
+  cps_target* cancel(timer& t) {
+    if (!t.pending())
+      return nullptr;
+    assert(t._wheel == this && "Cancelled a timer of another wheel");
+    unlink(t);
+    --_pending;
+    return exchange(t._waiter, nullptr);
+  }
+
+  // Processes every tick up to `now` and resumes the coroutines whose
+  // deadline has passed. Returns how many were resumed.
+  size_t advance(clock::time_point now = clock::now()) {
+    const uint64_t last = ticks_at(now, false);
+    size_t resumed = 0;
+    while (_current < last) {
+      if (_pending == 0) {
+        _current = last;
+        break;
+      }
+      resumed += process_tick();
+    }
+    return resumed;
+  }
+
+  // Advances the wheel in real time until no timer is pending, sleeping
+  // in between.
+  void run() {
+    while (_pending != 0) {
+      advance();
+      if (_pending != 0)
+        this_thread::sleep_until(time_of(next_tick()));
+    }
+  }
+
+  // How long until the next tick that may resume something, in
+  // milliseconds rounded up, as a poll timeout; -1 with nothing pending.
+  int next_timeout_ms(clock::time_point now = clock::now()) const {
+    if (_pending == 0)
+      return -1;
+    auto wait = time_of(next_tick()) - now;
+    if (wait <= clock::duration::zero())
+      return 0;
+    return int(chrono::ceil<chrono::milliseconds>(wait).count());
+  }
+
+  // The wheel's time: that of the last tick it processed.
+  clock::time_point now() const {
+    return time_of(_current);
+  }
+
+  clock::duration tick() const {
+    return _tick;
+  }
+
+  size_t pending() const {
+    return _pending;
+  }
+
+private:
+  friend class timer;
+
+  constexpr static uint64_t slot_mask = slots - 1;
+
+  // The span of the whole wheel; later deadlines wait in its last level
+  // and are placed again when their slot comes up.
+  constexpr static uint64_t max_delta = (uint64_t(1) << (slot_bits * levels)) - 1;
+
+  resume_continuation<void()>& arm(timer& t, uint64_t deadline) {
+    assert(!t.pending() && "Slept on a pending timer");
+    t._wheel = this;
+    t._deadline = deadline;
+    thread_local resume_continuation<void()> cont;
+    cont = resume_continuation<void()>(&t);
+    return cont;
+  }
+
+  uint64_t ticks_in(clock::duration d, bool round_up) const {
+    if (d <= clock::duration::zero())
+      return 0;
+    return uint64_t(d / _tick) + (round_up && d % _tick != clock::duration::zero());
+  }
+
+  uint64_t ticks_at(clock::time_point tp, bool round_up) const {
+    return ticks_in(tp - _origin, round_up);
+  }
+
+  clock::time_point time_of(uint64_t tick) const {
+    return _origin + tick * _tick;
+  }
+
+  // Called by the timer once its coroutine has suspended to it.
+  void schedule(timer& t, cps_target* waiter) {
+    t._waiter = waiter;
+    t._expired = false;
+    insert(t);
+    ++_pending;
+  }
+
+  void insert(timer& t) {
+    // Slots are indexed by the deadline's own bits, level by level, as in
+    // the classic Linux timer wheel; deadlines that have passed go in the
+    // next tick's slot.
+    const uint64_t next = _current + 1;
+    uint64_t expires = t._deadline < next ? next : t._deadline;
+    uint64_t delta = expires - next;
+    if (delta > max_delta) {
+      delta = max_delta;
+      expires = next + max_delta;
+    }
+    const unsigned level = delta < slots ? 0 : unsigned(bit_width(delta) - 1) / slot_bits;
+    link_before(_slots[level][(expires >> (slot_bits * level)) & slot_mask], t);
+  }
+
+  static void link_before(timer_link& head, timer_link& l) {
+    l.prev = head.prev;
+    l.next = &head;
+    head.prev->next = &l;
+    head.prev = &l;
+  }
+
+  static void unlink(timer_link& l) {
+    l.prev->next = l.next;
+    l.next->prev = l.prev;
+    l.prev = l.next = nullptr;
+  }
+
+  // Moves the whole list of `from` to the empty head `to`.
+  static void splice(timer_link& from, timer_link& to) {
+    if (from.next == &from) {
+      to.prev = to.next = &to;
+      return;
+    }
+    to.next = from.next;
+    to.prev = from.prev;
+    to.next->prev = &to;
+    to.prev->next = &to;
+    from.prev = from.next = &from;
+  }
+
+  // Places the timers of a higher slot again, now that the wheel has
+  // come to it.
+  void cascade(timer_link& slot) {
+    timer_link moving;
+    splice(slot, moving);
+    while (moving.next != &moving) {
+      timer& t = static_cast<timer&>(*moving.next);
+      unlink(t);
+      insert(t);
+    }
+  }
+
+  size_t process_tick() {
+    const uint64_t tick = _current + 1;
+    const unsigned index = tick & slot_mask;
+
+    // Each time a level wraps around, the next slot of the level above
+    // comes down.
+    for (unsigned level = 1, i = index; i == 0 && level < levels; ++level) {
+      i = (tick >> (slot_bits * level)) & slot_mask;
+      cascade(_slots[level][i]);
+    }
+    _current = tick;
+
+    // The whole slot at once: what its coroutines arm from here on goes
+    // in later ticks. They may still cancel timers of this batch, which
+    // just unlinks them from it.
+    timer_link expiring;
+    splice(_slots[0][index], expiring);
+
+    size_t resumed = 0;
+    while (expiring.next != &expiring) {
+      timer& t = static_cast<timer&>(*expiring.next);
+      unlink(t);
+      --_pending;
+      t._expired = true;
+      cps_run_loop::run(exchange(t._waiter, nullptr), {});
+      ++resumed;
+    }
+    return resumed;
+  }
+
+  // The next tick with a timer in the finest level, or at which a higher
+  // level comes down, whichever is first.
+  uint64_t next_tick() const {
+    uint64_t tick = _current + 1;
+    while ((tick & slot_mask) != 0) {
+      const timer_link& slot = _slots[0][tick & slot_mask];
+      if (slot.next != &slot)
+        break;
+      ++tick;
+    }
+    return tick;
+  }
+
+  const clock::duration _tick;
+  const clock::time_point _origin;
+  uint64_t _current = 0;
+  size_t _pending = 0;
+  timer_link _slots[levels][slots];
+};
+
+inline cps_target::cps_call_data timer::__body(cps_call_data call_data) {
+  assert(_wheel && "Suspended to a timer that was not armed");
+  _wheel->schedule(*this, call_data.cont);
+  return {{}, nullptr};
+}
+
+};
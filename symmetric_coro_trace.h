@@ -0,0 +1,297 @@
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "symmetric_coro_stats.h"
+
+namespace std {
+class cps_target;
+
+///////////////////////////////////////////////////////////
+// Tracing - records every hop of the trampoline in a per-thread ring
+// buffer, to see which coroutine resumed which and when.
+//
+// Compiled in with -DCPS_TRACING=1 and switched on at run time:
+//
+//   cps_trace::start();
+//   ... run the pipeline ...
+//   cps_trace::stop();
+//   cps_trace::set_name(&m, "multiply");
+//   cps_trace::write_chrome_trace("trace.json");
+//
+// The output loads in chrome://tracing or ui.perfetto.dev: each thread
+// is a track, each activation of a `__body` a slice nested in the body
+// that ran the trampoline, with the suspend point it resumed at and the
+// target that resumed it as arguments.
+//
+// Recording a hop costs a store of 32 bytes and a read of the TSC, which
+// dominates. Each thread only writes its own ring, so it takes no lock.
+// When a ring is full the oldest records are overwritten. Rings are read
+// by `records()` and the exporter, which must not run while traced
+// threads are still hopping.
+
+class cps_trace {
+public:
+  enum kind : uint32_t {
+    // An activation of `callee` at suspend point `sp`, resumed by `cont`.
+    hop,
+    // The same, for the first activation of a trampoline run; `cont` is
+    // nullptr.
+    enter,
+    // The trampoline run returns to its caller; `cont` made the last hop.
+    exit,
+  };
+
+  struct record {
+    uint64_t ticks;
+    const cps_target* callee;
+    const cps_target* cont;
+    int32_t sp;
+    kind what;
+  };
+
+  // Clears the rings and starts recording, keeping the last
+  // `capacity_per_thread` records (a power of two) of every thread.
+  static void start(size_t capacity_per_thread = size_t(1) << 16) {
+    assert(capacity_per_thread && (capacity_per_thread & (capacity_per_thread - 1)) == 0 &&
+           "Capacity must be a power of two");
+    registry& reg = get_registry();
+    lock_guard<mutex> lock(reg.lock);
+    reg.capacity = capacity_per_thread;
+    for (auto& r : reg.rings)
+      r->reset(capacity_per_thread);
+    _enabled.store(true, memory_order_relaxed);
+  }
+
+  static void stop() {
+    _enabled.store(false, memory_order_relaxed);
+  }
+
+  static bool enabled() {
+    return _enabled.load(memory_order_relaxed);
+  }
+
+  // Name of `target` in exported traces; unnamed targets show as addresses.
+  static void set_name(const cps_target* target, string name) {
+    registry& reg = get_registry();
+    lock_guard<mutex> lock(reg.lock);
+    reg.names[target] = std::move(name);
+  }
+
+  static inline __attribute__((always_inline))
+  void trace(kind what, const cps_target* callee, const cps_target* cont, int sp) {
+    if (!_enabled.load(memory_order_relaxed))
+      return;
+    ring* r = _ring;
+    if (!r)
+      r = attach();
+    r->push({cps_clock::now(), callee, cont, sp, what});
+  }
+
+  // The records still held for every thread that traced, oldest first.
+  static vector<vector<record>> records() {
+    registry& reg = get_registry();
+    lock_guard<mutex> lock(reg.lock);
+    vector<vector<record>> result;
+    for (auto& r : reg.rings)
+      result.push_back(r->snapshot());
+    return result;
+  }
+
+  // Writes the records in the Chrome trace event format. Returns false
+  // if the file could not be written.
+  static bool write_chrome_trace(const char* path) {
+    FILE* out = fopen(path, "w");
+    if (!out)
+      return false;
+    write_chrome_trace(out);
+    return fclose(out) == 0;
+  }
+
+  // `s` as the contents of a JSON string.
+  static string json_escape(const string& s) {
+    string escaped;
+    escaped.reserve(s.size());
+    for (char c : s) {
+      if (c == '"' || c == '\\') {
+        escaped += '\\';
+        escaped += c;
+      } else if ((unsigned char)c < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+        escaped += buf;
+      } else {
+        escaped += c;
+      }
+    }
+    return escaped;
+  }
+
+  static void write_chrome_trace(FILE* out) {
+    vector<vector<record>> threads = records();
+    map<const cps_target*, string> names;
+    {
+      registry& reg = get_registry();
+      lock_guard<mutex> lock(reg.lock);
+      names = reg.names;
+    }
+    for (auto& entry : names)
+      entry.second = json_escape(entry.second);
+
+    auto name_of = [&names](const cps_target* target) {
+      auto it = names.find(target);
+      if (it != names.end())
+        return it->second;
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%p", static_cast<const void*>(target));
+      return string(buf);
+    };
+
+    uint64_t origin = UINT64_MAX;
+    for (auto& t : threads)
+      if (!t.empty() && t.front().ticks < origin)
+        origin = t.front().ticks;
+    const double us_per_tick = cps_clock::ns_per_tick() / 1000.0;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    const char* separator = "";
+    for (size_t tid = 0; tid < threads.size(); ++tid) {
+      fprintf(out, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"name\":\"thread_name\","
+                   "\"args\":{\"name\":\"cps thread %zu\"}}",
+              separator, tid, tid);
+      separator = ",\n";
+
+      // The activation open in each nested trampoline run. A ring that
+      // wrapped may start inside a run, whose exit then has nothing to
+      // close.
+      vector<const record*> open;
+      auto close = [&](const record* begin, uint64_t end) {
+        if (!begin)
+          return;
+        fprintf(out, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"cat\":\"cps\",\"name\":\"%s\","
+                     "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"sp\":%d,\"from\":\"%s\"}}",
+                separator, tid, name_of(begin->callee).c_str(),
+                double(begin->ticks - origin) * us_per_tick, double(end - begin->ticks) * us_per_tick,
+                begin->sp, begin->cont ? name_of(begin->cont).c_str() : "caller");
+      };
+
+      for (const record& r : threads[tid]) {
+        switch (r.what) {
+        case enter:
+          open.push_back(nullptr);
+          [[fallthrough]];
+        case hop:
+          if (open.empty())
+            open.push_back(nullptr);
+          close(open.back(), r.ticks);
+          open.back() = &r;
+          break;
+        case exit:
+          if (!open.empty()) {
+            close(open.back(), r.ticks);
+            open.pop_back();
+          }
+          break;
+        }
+      }
+      // Runs still going when the trace stopped end at their last record.
+      const uint64_t last = threads[tid].empty() ? 0 : threads[tid].back().ticks;
+      while (!open.empty()) {
+        close(open.back(), last);
+        open.pop_back();
+      }
+    }
+    fprintf(out, "\n]}\n");
+  }
+
+private:
+  class ring {
+  public:
+    explicit ring(size_t capacity) { reset(capacity); }
+
+    void reset(size_t capacity) {
+      if (capacity != _capacity) {
+        _slots.reset(new record[capacity]);
+        _capacity = capacity;
+      }
+      _head.store(0, memory_order_relaxed);
+    }
+
+    // Owner thread only.
+    inline __attribute__((always_inline)) void push(const record& r) {
+      uint64_t head = _head.load(memory_order_relaxed);
+      _slots[head & (_capacity - 1)] = r;
+      _head.store(head + 1, memory_order_release);
+    }
+
+    vector<record> snapshot() const {
+      uint64_t head = _head.load(memory_order_acquire);
+      uint64_t first = head > _capacity ? head - _capacity : 0;
+      vector<record> result;
+      result.reserve(head - first);
+      for (uint64_t i = first; i < head; ++i)
+        result.push_back(_slots[i & (_capacity - 1)]);
+      return result;
+    }
+
+    bool owned = false;
+
+  private:
+    unique_ptr<record[]> _slots;
+    size_t _capacity = 0;
+    atomic<uint64_t> _head{0};
+  };
+
+  struct registry {
+    mutex lock;
+    size_t capacity = size_t(1) << 16;
+    vector<unique_ptr<ring>> rings;
+    map<const cps_target*, string> names;
+  };
+
+  static registry& get_registry() {
+    static registry reg;
+    return reg;
+  }
+
+  // Gives the calling thread a ring. Rings of exited threads are reused,
+  // the new thread's records following theirs.
+  static __attribute__((noinline)) ring* attach() {
+    struct release_on_exit {
+      ~release_on_exit() {
+        if (ring* r = _ring) {
+          lock_guard<mutex> lock(get_registry().lock);
+          r->owned = false;
+          _ring = nullptr;
+        }
+      }
+    };
+    thread_local release_on_exit releaser;
+    (void)releaser;
+
+    registry& reg = get_registry();
+    lock_guard<mutex> lock(reg.lock);
+    for (auto& r : reg.rings) {
+      if (!r->owned) {
+        r->owned = true;
+        return _ring = r.get();
+      }
+    }
+    reg.rings.emplace_back(new ring(reg.capacity));
+    reg.rings.back()->owned = true;
+    return _ring = reg.rings.back().get();
+  }
+
+  static inline atomic<bool> _enabled{false};
+  static inline thread_local ring* _ring = nullptr;
+};
+
+};
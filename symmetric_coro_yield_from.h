@@ -0,0 +1,81 @@
+#pragma once
+
+#include <assert.h>
+#include <utility>
+
+#include "symmetric_coro.h"
+
+namespace std {
+///////////////////////////////////////////////////////////
+// Delegating generators - `yield_from(child)` yields every value of
+// a child generator to the consumer directly, instead of resuming the
+// child and yielding each value on up through every level in between.
+//
+// A recursive generator written with plain yields, such as a tree walk
+// where each node re-yields its subtrees' values, costs two hops per
+// level for every value. A delegating generator hands its caller - the
+// consumer - over to the child, so the child yields to the consumer
+// straight away, and the consumer's continuation of the outermost
+// generator ends up pointing at the child: it is resumed directly as
+// well. Only when the child finishes does it hop back to its parent,
+// handing the caller back with its last value, which is what
+// `yield_from` evaluates to. Each value then costs O(1) hops whatever the
+// depth, plus one hop back per child.
+//
+//   `v = yield_from(child)`, where `child` is a delegating generator   >>>
+//   ```
+//     return prepare_to_yield_from(N, child);
+//   case N:
+//     v = process_yield_from(child, call_data);
+//   ```
+//
+// and the body of a delegating generator starts with `process_start`
+// instead of `process_resume`, as its caller may already have been
+// handed over, and ends with `prepare_to_return` instead of a suspend to
+// `get_caller()`, to hop back to its parent if it has one.
+//
+// The consumer resumes the outermost generator as usual and checks its
+// `done()`, which only becomes true with the very last value.
+
+template<class R> class delegating_coroutine : public coroutine<R()> {
+protected:
+  using typename coroutine<>::cps_call_data;
+  using typename coroutine<>::suspend_point;
+
+  // At the initial suspend point.
+  void process_start(cps_call_data& call_data) {
+    if (!_parent)
+      this->process_resume(this->get_caller(), call_data);
+  }
+
+  cps_call_data prepare_to_yield_from(suspend_point sp, delegating_coroutine& child) {
+    assert(!child._parent && child.get_suspend_point() == 0 && "Delegated to a started generator");
+    child._parent = this;
+    child.get_caller() = std::move(this->get_caller());
+    return this->prepare_to_suspend(sp, child.get_cont());
+  }
+
+  // The child's last value. It has handed the caller back.
+  R process_yield_from(delegating_coroutine& child, cps_call_data& call_data) {
+    assert(child.done());
+    (void)child;
+    return call_data.data;
+  }
+
+  // `return val`: to the parent, with the caller, if this generator was
+  // delegated to; to the caller otherwise.
+  template<typename ValType>
+  cps_call_data prepare_to_return(ValType&& val) {
+    if (delegating_coroutine* parent = _parent) {
+      parent->get_caller() = std::move(this->get_caller());
+      parent->get_cont() = resume_continuation<R()>(parent);
+      return this->prepare_to_suspend(coroutine<>::_sp_done, parent->get_cont(), std::forward<ValType>(val));
+    }
+    return this->prepare_to_suspend(coroutine<>::_sp_done, this->get_caller(), std::forward<ValType>(val));
+  }
+
+private:
+  delegating_coroutine* _parent = nullptr;
+};
+
+};